@@ -21,8 +21,9 @@
  *             micro-seconds, on average (roughly 650 Hz).  Because data 
  *             is sent when the clock is low and read when the clock is high,
  *             we must run the processClockCycle() method at least every
- *             800 micro-seconds.  The more frequently the processClockCycle
- *             method is called, the more likely data transmission will
+ *             750 micro-seconds (half a bit, less the panel's jitter).
+ *             The more frequently the processClockCycle method is
+ *             called, the more likely data transmission will
  *             succeed (in both directions) without data loss.  If you're
  *             not sure if you can commit to a calling the processClockCycle()
  *             function frequently enough, then you can use 
@@ -145,6 +146,12 @@
  */
 
 #include "PC1550.h"
+#include "PC1550Trace.h"
+#include <string.h>
+
+#if defined(__AVR__)
+#include <avr/sleep.h>
+#endif
 
 /* ==================================================================== */
 /*       S T A T I C    /    P R I V A T E      H E L P E R S           */
@@ -214,51 +221,51 @@ char PC1550::keyReleased(){
 }
 
 bool PC1550::Zone1Light(){
-  return (available_controller_data >> 15);
+  return (available_controller_data & 0b1000000000000000) > 0;
 }
 
 bool PC1550::Zone2Light(){
-  return (available_controller_data << 1 >> 15);
+  return (available_controller_data & 0b0100000000000000) > 0;
 }
 
 bool PC1550::Zone3Light(){
-  return (available_controller_data << 2 >> 15);
+  return (available_controller_data & 0b0010000000000000) > 0;
 }
 
 bool PC1550::Zone4Light(){
-  return (available_controller_data << 3 >> 15);
+  return (available_controller_data & 0b0001000000000000) > 0;
 }
 
 bool PC1550::Zone5Light(){
-  return (available_controller_data << 4 >> 15);
+  return (available_controller_data & 0b0000100000000000) > 0;
 }
 
 bool PC1550::Zone6Light(){
-  return (available_controller_data << 5 >> 15);
+  return (available_controller_data & 0b0000010000000000) > 0;
 }
 
 bool PC1550::ReadyLight(){
-  return (available_controller_data << 8  >> 15);
+  return (available_controller_data & 0b0000000010000000) > 0;
 }
 
 bool PC1550::ArmedLight(){
-  return (available_controller_data << 9 >> 15);
+  return (available_controller_data & 0b0000000001000000) > 0;
 }
 
 bool PC1550::MemoryLight(){
-  return (available_controller_data << 10 >> 15);
+  return (available_controller_data & 0b0000000000100000) > 0;
 }
 
 bool PC1550::BypassLight(){
-  return (available_controller_data << 11 >> 15);
+  return (available_controller_data & 0b0000000000010000) > 0;
 }
 
 bool PC1550::TroubleLight(){
-  return (available_controller_data << 12 >> 15);
+  return (available_controller_data & 0b0000000000001000) > 0;
 }
 
 bool PC1550::Beep(){
-  return (available_controller_data << 15 >> 15);
+  return (available_controller_data & 0b0000000000000001) > 0;
 }
 
 uint16_t PC1550::consecutiveBeeps(){
@@ -269,12 +276,37 @@ bool PC1550::atTransmissionEnd(){
   return bTransmissionEnd;
 }
 
+//true for one execution of processClockCycle once the first 8 controller
+//bits of a cycle are in, about half a cycle before atTransmissionEnd()
+bool PC1550::atHalfFrame(){
+  return bHalfFrame;
+}
+
+//the zone lights, PC16-OUT zones and keypad byte of the cycle being read,
+//as soon as they are complete.  They are provisional until the rest of
+//the cycle arrives, and if it never does they stay so until the next
+//frame replaces them.  Once the frame is in, this returns its first half
+//with provisional false
+PC1550::HalfFrame PC1550::halfFrame(){
+  HalfFrame half;
+  half.lights = half_frame.controller_data >> 8;
+  half.tripped = half_frame.pc16out_data >> 8;
+  half.keypad = half_frame.keypad_data;
+  half.key = half_frame.keypad_data ? getKeyChar(half_frame.keypad_data) : '\0';
+  half.provisional = half_provisional;
+  half.time = half_frame.time;
+  return half;
+}
+
 uint16_t PC1550::consecutiveKeyPresses(){
   return iConsecutiveKeyPressCycles;
 }
 
 bool PC1550::readyForKeyPress(){
-  if (keyHoldCycles > 0 || cyclesWithoutKey < 1){
+  //queued sequences, and keys to be sent again, go first
+  if (key_queue_head != key_queue_tail || retry_key != 0)
+    return false;
+  if (keyHoldCycles > 0 || cyclesWithoutKey < 1 || bus_keypad_data != 0){
     return false;
   }
   return true;
@@ -287,12 +319,37 @@ bool PC1550::sendKey(char c, uint8_t holdCycles){
   uint8_t keyval = getKeyValue(c);
   if (keyval == 0) {return false; }
 
+  //the interrupt handler must never see the key without its hold cycles
+  noInterrupts();
   this->key_to_send = keyval;
   this->keyHoldCycles = holdCycles;
+  this->sending_hold = holdCycles;
+  this->key_retries_left = PC1550_KEY_RETRIES;
+  this->key_first_cycle = true;
+  interrupts();
   return true;
 }
 
 
+//everything the accessors above report, taken from the latest frame, with
+//masks of the bits that changed from the frame before it.  Before the
+//first frame everything is zero
+PC1550::Snapshot PC1550::snapshot(){
+  Snapshot snap;
+  snap.controller = available_controller_data;
+  snap.pc16out = available_pc16out_data;
+  snap.keypad = available_keypad_data;
+  snap.key = available_keypad_data ? getKeyChar(available_keypad_data) : '\0';
+  snap.controllerChanged = controller_changed;
+  snap.pc16outChanged = pc16out_changed;
+  snap.keypadChanged = keypad_changed;
+  snap.consecutiveBeeps = iConsecutiveBeeps;
+  snap.consecutiveKeyPresses = iConsecutiveKeyPressCycles;
+  snap.sequence = frames_published;
+  snap.time = frame_time;
+  return snap;
+}
+
 //configured based on programming of PC1550
 bool PC1550::PGMOutput(){
   return (available_pc16out_data & 0b0000000000000001) > 0;
@@ -409,11 +466,71 @@ PC1550::PC1550(uint8_t datapin, uint8_t clockpin, uint8_t pgmpin){
   bTransmissionEnd = false;
   pc16out_data = 0;
   available_pc16out_data = 0;
+  interruptDriven = false;
+  frame_head = 0;
+  frame_tail = 0;
+  memset(&diag, 0, sizeof(diag));
+  last_poll = micros();
+  bit_period = PC1550_BIT_PERIOD_US;
+  sync_gap = PC1550_SYNC_GAP_US;
+  idle_since = last_read;
+  last_sample = last_read;
+  key_sent = 0;
+  event_head = 0;
+  event_tail = 0;
+  events_dropped = 0;
+  recorder = 0;
+  keypad_sample_pending = false;
+  keypad_edge_time = 0;
+  keypad_sample = HIGH;
+  controller_changed = 0;
+  pc16out_changed = 0;
+  keypad_changed = 0;
+  frames_published = 0;
+  frame_time = 0;
+  filter_reads = 0;
+  filter_min_pulse = 0;
+  filtered_clock = HIGH;
+  clock_changing = false;
+  clock_change_time = 0;
+  timerDriven = false;
+  capture_timed = false;
+  settling = false;
+  timer_period = 0;
+  sampling_sooner = false;
+  key_queue_head = 0;
+  key_queue_tail = 0;
+  next_sequence = 1;
+  sending_sequence = 0;
+  sending_last = false;
+  sending_hold = 0;
+  key_retries_left = 0;
+  key_first_cycle = false;
+  retry_key = 0;
+  bus_keypad_data = 0;
+  finished_sequence = 0;
+  finished_sent = false;
+  keys_done = 0;
+  keys_done_sent = false;
+  memset(&half_frame, 0, sizeof(half_frame));
+  half_provisional = false;
+  bHalfFrame = false;
+  half_head = 0;
+  half_tail = 0;
+  half_open = false;
+  gap_timed = false;
+  after_frame = false;
+  power_since = last_poll;
+  asleep_us = 0;
+  sleeps = 0;
+  sleeping = false;
+  woke_at = 0;
 }
 
 //this calls processClockCycle() until a full 16 bits are read and processed
 //this takes (at a minimum) 57ms.  If out of synchronization, this could
-//take twice as long (104ms).
+//take twice as long (104ms).  See poll() for a version that gives control
+//back between edges.
 void PC1550::processTransmissionCycle(){
   do{
     processClockCycle();
@@ -421,78 +538,402 @@ void PC1550::processTransmissionCycle(){
   while (!atTransmissionEnd());
 }
 
+//Does the work the bus needs now and returns the number of microseconds
+//until it next needs any (see nextEdgeDueUs()), so that the sketch can get
+//on with something else in the meantime:
+//
+//    unsigned long due = micros();
+//    void loop(){
+//      if ((long)(micros() - due) >= 0){
+//        due = micros() + alarm.poll();
+//        if (alarm.atTransmissionEnd()) ...
+//      }
+//      doSomethingShort();
+//    }
+//
+//With maxMicros, it keeps going for up to that long, waiting here for
+//edges that are due within it, and so saves the sketch coming back for
+//edges that are only a few microseconds away.  It always returns at the
+//end of a frame or half frame, so that atTransmissionEnd() and
+//atHalfFrame() can be checked.
+unsigned long PC1550::poll(unsigned long maxMicros){
+  unsigned long start = micros(), due;
+  do{
+    processClockCycle();
+  }
+  while (pollWait(start, maxMicros, due));
+  return due;
+}
+
+//the rest of a turn of poll(), after processClockCycle(): sets due, and
+//if there is budget left to wait that long, waits and returns true
+bool PC1550::pollWait(unsigned long start, unsigned long maxMicros,
+                      unsigned long &due){
+  due = nextEdgeDueUs();
+  if (bTransmissionEnd || bHalfFrame)
+    return false;
+
+  unsigned long spent = micros() - start;
+  if (spent >= maxMicros || due > maxMicros - spent)
+    return false;
+  //an edge that is late is waited for a microsecond at a time, which
+  //also moves time on for backends where only delays do
+  delayMicroseconds(due > 0 ? due : 1);
+  return true;
+}
+
+//How long processClockCycle() can be left alone, in microseconds, worked
+//out from the measured bus timing.  That is until a keypad bit has
+//settled, until the next controller bit or keypad bit is due, and
+//otherwise until the middle of the LOW half of the bit, which is all that
+//needs seeing of it.  That makes it a few hundred microseconds within a
+//frame and most of the 26.5ms gap after one.  To catch an edge that comes
+//early, it first asks to be called PC1550_EDGE_MARGIN_US ahead of it and
+//then again when it is due.  An edge that is late is polled for
+//continuously until it comes, and while the decoder is finding the gap it
+//has to watch the clock closely.
+//
+//When interrupt driven, it is the time until the next frame or half frame
+//could be waiting to be published, or 0 if one already is.
+unsigned long PC1550::nextEdgeDueUs(){
+  unsigned long now = micros();
+  unsigned long from = last_read;
+  unsigned long wait;
+
+  if (interruptDriven){
+    noInterrupts();
+    bool waiting = frame_head != frame_tail ||
+      (half_open && half_tail != half_head);
+    bool synced = synchronized && (controller_bits_read > 0 || gap_timed);
+    uint8_t bits = controller_bits_read;
+    from = last_read;
+    interrupts();
+    if (waiting)
+      return 0;
+    if (!synced)
+      return syncIdleUs();
+    wait = (unsigned long)((bits < 8 ? 8 : 16) - bits) * bit_period;
+    if (bits == 0)
+      wait += sync_gap;
+  }
+  else if (clock_changing)
+    return 0;
+  else if (keypad_sample_pending){
+    from = keypad_edge_time;
+    wait = PC1550_KEYPAD_SETTLE_US;
+  }
+  else if (!synchronized || (controller_bits_read == 0 && !gap_timed))
+    return bit_period / 4;
+
+  //the clock falls half a period after each bit, and the next bit follows
+  //a period after it (after the last bit of a cycle, a period and the
+  //gap).  The clock has to be seen LOW in between, even where it doesn't
+  //matter when it fell
+  else if (last_clock && controller_bits_read > 0 && controller_bits_read < 8)
+    wait = bit_period / 2;
+  else if (last_clock)
+    wait = bit_period * 3 / 4;
+  else if (controller_bits_read == 0)
+    wait = bit_period + sync_gap;
+  else
+    wait = bit_period;
+
+  unsigned long elapsed = now - from;
+  if (elapsed >= wait)
+    return 0;
+  wait -= elapsed;
+  return wait > PC1550_EDGE_MARGIN_US ? wait - PC1550_EDGE_MARGIN_US : wait;
+}
+
 //This processes every clock cycle from the PC1550 control panel.
 //This should be called within the Arduino loop() function at least
-//every 800us.  If you're not sure you can commit to that frequency
+//every 750us.  If you're not sure you can commit to that frequency
 //then call processTransmissionCycle() which will hold control for
 //at least one full transmission cycle
+//
+//When interrupt capture or timer sampling is enabled the bus is read by
+//an interrupt handler instead, and this publishes at most one queued
+//frame per call.  It can then be called as infrequently as the
+//application likes, so long as the frame queue does not fill up.
 void PC1550::processClockCycle(){
-  
-  //clear the bTransmissionEnd flag
-  bTransmissionEnd = false;
+  unsigned long now = micros();
+  if (!startClockCycle(now))
+    return;
+  sampleBus(now);
+}//end processClockCycle()
 
+//reads the lines once and acts on them.  Called by processClockCycle()
+//when polling and by the timer interrupt when timer sampling
+void PC1550::sampleBus(unsigned long now){
   //read our clock and data values
   boolean clock = digitalRead(clockpin);
   boolean data = digitalRead(datapin);
   boolean pgmData = digitalRead(pgmpin);
 
-  //how long has it been since we last read a byte?
-  unsigned long time_since_last_read = micros() - last_read;
+  traceLines(clock, data, pgmData, now);
+
+  //when filtering glitches, vote on several reads of each line, and on a
+  //change of the clock keep sampling until it has lasted the minimum pulse
+  if (filter_reads > 0){
+    uint8_t clockHigh = clock, dataHigh = data, pgmHigh = pgmData;
+    readVotes(filter_reads - 1, clockHigh, dataHigh, pgmHigh);
+    while (filterLines(clockHigh, dataHigh, pgmHigh, now,
+                       clock, data, pgmData)){
+      //from the timer, sample again sooner rather than wait here
+      if (timerDriven){
+        sampling_sooner = true;
+        startTimer((filter_min_pulse + 1) / 2);
+        return;
+      }
+      delayMicroseconds((filter_min_pulse + 1) / 2);
+      now = micros();
+      clockHigh = dataHigh = pgmHigh = 0;
+      readVotes(filter_reads, clockHigh, dataHigh, pgmHigh);
+    }
+  }
+  if (sampling_sooner){
+    sampling_sooner = false;
+    startTimer(timer_period);
+  }
+
+  checkSyncGap(clock, now);
+  driveBus(readClockEdge(clock, data, pgmData, now));
+}
+
+//clears the per-call flags and, when interrupt driven, publishes the next
+//queued frame.  Returns true if the caller should go on to poll the bus.
+bool PC1550::startClockCycle(unsigned long now){
   
+  //clear the bTransmissionEnd and bHalfFrame flags
+  bTransmissionEnd = false;
+  bHalfFrame = false;
+
+  //keep track of the longest stretch the sketch left us alone
+  unsigned long poll_gap = now - last_poll;
+  last_poll = now;
+  if (poll_gap > diag.maxPollGapUs)
+    diag.maxPollGapUs = poll_gap;
+
+  if (interruptDriven){
+    //unless the clock interrupt may run the timer, a keypad bit or a
+    //change of the clock it left waiting is finished here
+    if (!timerDriven && !capture_timed){
+      noInterrupts();
+      if (keypad_sample_pending || clock_changing)
+        captureLines(false);
+      interrupts();
+    }
+
+    if (frame_tail != frame_head){
+      publishFrame(frame_queue[frame_tail]);
+      frame_tail = (frame_tail + 1) & (PC1550_FRAME_QUEUE_SIZE - 1);
+    }
+
+    //the first half of the cycle being read is newer than anything
+    //queued, so it waits until the queue is empty.  The handler rewrites
+    //half_queued in place, so it is copied whole with the handler held
+    //off, and dropped if its frame ended meanwhile
+    else if (half_open && half_tail != half_head){
+      noInterrupts();
+      Frame half = half_queued;
+      bool open = half_open;
+      half_tail = half_head;
+      interrupts();
+      if (open)
+        publishHalfFrame(half);
+    }
+    return false;
+  }
+  return true;
+}
+
+//resynchronizes when the panel has been idle long enough to mark the
+//gap between transmission cycles
+void PC1550::checkSyncGap(bool clock, unsigned long now){
+
+  //a controller bit could have come and gone unseen if the samples are
+  //further apart than the clock stays HIGH, so the idle clock has to be
+  //watched again from here
+  if (clock || now - last_sample > bit_period / 2)
+    idle_since = now;
+  last_sample = now;
+
   //if the clock is hanging (clock line is remains HIGH so clock
   //variable remains false for an extended period) then the controller
   //is telling us that it is done with its last transmission cycle.
-  //we can now enter a synchronized state
-  if (!clock && time_since_last_read > 25000 && time_since_last_read < 28000){
+  //It never idles for two bit periods within a cycle, so that is all
+  //we need to see, from startup or after losing track of the bus, to
+  //enter a synchronized state.  Once synchronized we stay that way
+  //from one cycle to the next
+  if (!clock && now - idle_since > syncIdleUs() &&
+      (!synchronized || controller_bits_read > 0))
+    resetFrame();
+}
 
-    //at this point we should be synchronized
-    synchronized = true;
-    
-    //reset the cycle
-    controller_bits_read = 0;
-    controller_data = 0;
-    pc16out_data = 0;
-    keypad_bits_read = 0;
-    keypad_data = 0;
-    keypad_bits_sent = 0;
+//an idle clock longer than this can only be the gap between cycles
+unsigned long PC1550::syncIdleUs(){
+  return 2UL * bit_period;
+}
+
+//carries out the bus actions requested by readClockEdge() using the
+//runtime pin numbers
+void PC1550::driveBus(uint8_t actions){
+  //this will let the voltage float to whatever the panel is driving
+  //which will allow other keypads to drive the line and for us to
+  //see what other keypads are driving between receive bits
+  //if no other keypad is driving, the line will pull high since
+  //the dsc 1550 panel is pulling high...so the line should go back to 5v
+  if (actions & RELEASE_DATA)
+    pinMode(datapin,INPUT);
+
+  //this will effectively pull the voltage low on the line
+  //getting it close to zero (if not zero)
+  if (actions & DRIVE_DATA)
+    pinMode(datapin,OUTPUT);
+}
+
+//enter a synchronized state and start assembling a new transmission cycle
+void PC1550::resetFrame(){
+
+  //bits read since the last sync that never made up a frame
+  if (controller_bits_read > 0)
+    diag.framesAbandoned++;
+
+  //a key went out in a frame we never finished reading, so there is no
+  //telling whether the panel took it
+  if (key_sent != 0){
+    keyResult(false);
+    key_sent = 0;
   }
-  
+
+  //finding the gap again means we lost track of the bus (or just
+  //started)
+  if (!synchronized)
+    diag.resyncs++;
+
+  //at this point we should be synchronized
+  synchronized = true;
+  half_open = false;
+  gap_timed = false;
+  clearFrame();
+}
+
+//gives up on the transmission cycle being read, and stops sending into
+//it.  The bus is found again at the next gap
+void PC1550::loseSync(){
+  synchronized = false;
+  transmitting = false;
+  after_frame = false;
+}
+
+//starts assembling a new transmission cycle
+void PC1550::clearFrame(){
+  controller_bits_read = 0;
+  controller_data = 0;
+  pc16out_data = 0;
+  keypad_bits_read = 0;
+  keypad_data = 0;
+  keypad_bits_sent = 0;
+  keypad_sample_pending = false;
+}
+
+//acts on a change of the clock line, reading controller and keypad bits
+//and deciding when our own key bits are driven.  This does no I/O of its
+//own: it returns the bus actions (RELEASE_DATA, DRIVE_DATA) the caller must
+//carry out, so the same logic serves the polling, interrupt driven and
+//port register paths.
+uint8_t PC1550::readClockEdge(bool clock, bool data, bool pgmData,
+                              unsigned long now){
+  uint8_t actions = 0;
+
+  //a keypad bit is waiting for the line to settle.  Take it from the
+  //first sample that is late enough, as long as the panel hasn't moved
+  //on to its next bit.  If it has, we weren't polled again in time and
+  //the latest sample taken while the clock was still HIGH is used.
+  if (keypad_sample_pending){
+    if (clock && last_clock != clock){
+      keypad_sample_pending = false;
+      keypadBit(keypad_sample);
+      diag.lateKeypadSamples++;
+    }
+    else if (now - keypad_edge_time >= PC1550_KEYPAD_SETTLE_US){
+      keypad_sample_pending = false;
+      keypadBit(data);
+    }
+    else
+      keypad_sample = data;
+  }
+
   //key press bits are transmitted with the clock is HIGH
   //a HIGH clock line means the clock variable will be false
   if (!clock && last_clock != clock){
     
     //we read key presses via the 7 bits transmitted BETWEEN
-    //the first 8 bits received from the control plannel
+    //the first 8 bits received from the control plannel.
+    //The keypad needs time to drive the line after the clock changes,
+    //so rather than waiting here we note when the edge was seen and
+    //sample on a later call
     if (controller_bits_read > 0 && controller_bits_read < 8){
-      
-      //The Atmega on the Arduino has one ADC that is multiplexed for all the 
-      //analog pins.  When we do an analogRead(), a multiplexer connects the 
-      //pin we are reading to the ADC. This works fine for low impedance 
-      //voltage sources but it takes time for a high impedance sensor to 
-      //change the  voltage at the ADC after this switch of pins.
-      
-      //so we read once to switch pins
-      digitalRead(datapin);
-      
-      //wait 100 microseconds to ensure the ADC has the right voltage
-      delayMicroseconds(100);
-      
-      //then we read again
-      uint8_t bitValue = (uint8_t)(!digitalRead(datapin));
-      
-      //update our keypad_data field and increment the count of bits read
-      keypad_data |= (bitValue << (6 - keypad_bits_read));
-      keypad_bits_read++;     
-    }//end if between bits 1 and 8
-
+      keypad_sample_pending = true;
+      keypad_sample = data;
+      keypad_edge_time = now;
+    }
   }//end if clock is HIGH/OFF
 
   //we read all other bits on a LOW clock line
   //a LOW clock line will mean the clock variable will be true
   if (clock && last_clock != clock){
 
+    //a long idle clock that didn't get us synchronized is a sync gap
+    //we didn't watch closely enough
+    unsigned long bit_time = now - last_read;
+    if (!synchronized && bit_time > PC1550_BIT_GAP_US)
+      diag.syncGapsMissed++;
+
+    //the first bit after a frame we read ends a gap we can measure.  A
+    //late poll lengthens it as much as it delays the bit
+    if (after_frame && controller_bits_read == 0){
+      unsigned long gap = bit_time - bit_period;
+      if (bit_time < bit_period || gap < PC1550_SYNC_GAP_MIN_US ||
+          gap > PC1550_SYNC_GAP_MAX_US)
+        diag.syncGapsOutOfRange++;
+    }
+    after_frame = false;
+
+    if (synchronized){
+      //a cycle starts after the gap, and its bits come one period apart.
+      //Anything else means we missed an edge (the sketch was late) or
+      //counted one that wasn't there, so give up on the frame now rather
+      //than publish it misaligned.  It is counted as abandoned at the
+      //next gap.  Straight after a frame we never watched the gap, so a
+      //first bit later than the gap allows means the loop stalled past
+      //it and this is a bit further into the cycle
+      bool lost;
+      if (controller_bits_read == 0)
+        lost = bit_time < syncIdleUs() ||
+          (gap_timed && bit_time > (unsigned long)bit_period + sync_gap + bit_period / 2);
+      else
+        lost = bit_time > bit_period + bit_period / 2;
+
+      if (lost)
+        loseSync();
+
+      //otherwise, refine the measured timing.  The gap is kept to what
+      //its 16 bits can hold
+      else if (controller_bits_read == 0){
+        unsigned long gap = bit_time - bit_period;
+        if (gap < 4UL * PC1550_SYNC_GAP_US){
+          if (gap > 0xFFFF)
+            gap = 0xFFFF;
+          sync_gap += ((long)gap - sync_gap) / 8;
+        }
+      }
+      else
+        bit_period += ((long)bit_time - bit_period) / 8;
+    }
+
     //update the last time we read a bit
-    last_read = micros();
+    last_read = now;
     
     //store the bit read (controller data)
     uint16_t dataValue = ((uint16_t)data) << (15 - controller_bits_read);
@@ -507,9 +948,24 @@ void PC1550::processClockCycle(){
     
     //if this is the first bit, see if we should be sending a key
     if (synchronized && controller_bits_read == 1){
+      //the panel only takes a key after a cycle in which no keypad sent
+      //one.  A key to be sent again goes out ahead of the queued ones
+      if (key_to_send == 0 && keyHoldCycles == 0 && cyclesWithoutKey > 0 &&
+          bus_keypad_data == 0){
+        if (retry_key != 0){
+          key_to_send = retry_key;
+          keyHoldCycles = sending_hold;
+          key_first_cycle = true;
+          retry_key = 0;
+        }
+        else if (key_queue_tail != key_queue_head && finished_sequence == 0)
+          nextQueuedKey();
+      }
+
       if (key_to_send != 0){
 	cyclesWithoutKey = 0;
 	transmitting = true;
+	key_sent = key_to_send;
       }
       else
 	cyclesWithoutKey++;
@@ -519,22 +975,19 @@ void PC1550::processClockCycle(){
     if (controller_bits_read >= 8)
       transmitting = false;
 
-    //this will let the voltage float to whatever the panel is driving
-    //which will allow other keypads to drive the line and for us to
-    //see what other keypads are driving between receive bits
-    //if no other keypad is driving, the line will pull high since
-    //the dsc 1550 panel is pulling high...so the line should go back to 5v
-    pinMode(datapin,INPUT);
+    //the zone bits and the keypad byte are complete half way through
+    if (synchronized && controller_bits_read == 8)
+      halfFrameComplete(now);
+
+    //let the line float so other keypads can be seen between bits
+    actions |= RELEASE_DATA;
     
     //if in transmit mode
     if (transmitting){
       //it is going to pull HIGH by default, so we only drive
       //low if the bit for this place in the sequence is set
-      if (((key_to_send >> (7-controller_bits_read)) & 0x01)){
-	//this will effectively pull the voltage low on the line
-	//getting it close to zero (if not zero)
-	pinMode(datapin,OUTPUT);
-      }
+      if (((key_to_send >> (7-controller_bits_read)) & 0x01))
+	actions |= DRIVE_DATA;
       
       //if we've sent the last bit, we can clear our key sending fields
       if (controller_bits_read == 7){
@@ -548,64 +1001,956 @@ void PC1550::processClockCycle(){
   }
 
   //if we successfully received 16 bits, then update available data
-  if (synchronized && controller_bits_read == 16){
-    if (this->available_controller_data != controller_data)
-      this->bStateChanged = true;
-    else
-      this->bStateChanged = false;
-    
-    //if we received keypad_data
-    if (keypad_data != 0){
-      //if it's the exact same as last time
-      if (this->available_keypad_data == keypad_data){
-	bKeyPressed = false;
-	key_released_data = 0;
-	iConsecutiveKeyPressCycles++;
-      }
-      else if (this->available_keypad_data == 0){
-	bKeyPressed = true;
-	key_released_data = 0;
-	iConsecutiveKeyPressCycles = 1;
-      }
-      else if (this->available_keypad_data != 0){
-	//this is a highly unlikely state
-	//where two different key-presses occur in back to back cycles
-	//the PC1550 controller does require a cycle of no transmission
-	//between each key-press so this *should* never occur
-	bKeyPressed = true;
-	iConsecutiveKeyPressCycles = 1;
-	this->key_released_data = available_keypad_data;
-      }
+  if (synchronized && controller_bits_read == 16)
+    frameComplete(now);
+
+  last_clock = clock;
+  return actions;
+}//end readClockEdge()
+
+//records a settled keypad bit.  dataLine is the level read from the data
+//line (LOW means the bit is on)
+void PC1550::keypadBit(bool dataLine){
+  uint8_t bitValue = (uint8_t)(!dataLine);
+      
+  //update our keypad_data field and increment the count of bits read
+  keypad_data |= (bitValue << (6 - keypad_bits_read));
+  keypad_bits_read++;     
+}
+
+//hands a completed transmission cycle to the main loop.  When polling
+//this publishes it immediately; when interrupt driven the frame is queued
+//until processClockCycle() gets around to it.
+void PC1550::frameComplete(unsigned long now){
+  diag.framesDecoded++;
+
+  Frame frame;
+  frame.key_failed = 0;
+  frame.key_collided = false;
+
+  //a key we sent is confirmed when the bus carried exactly that key.  The
+  //line is wired-AND, so another keypad pressed at the same moment adds
+  //its bits to ours, while bits of ours that are missing never made it
+  //onto the line
+  if (key_sent != 0){
+    diag.keysSent++;
+    if (keypad_data == key_sent)
+      diag.keysConfirmed++;
+    else{
+      frame.key_failed = key_sent;
+      frame.key_collided = (keypad_data & key_sent) == key_sent;
+      if (frame.key_collided)
+        diag.keyCollisions++;
+      else
+        diag.keysMissed++;
     }
-    //if keypad_data == 0
+    keyResult(keypad_data == key_sent);
+    key_sent = 0;
+  }
+  bus_keypad_data = keypad_data;
+
+  frame.controller_data = controller_data;
+  frame.pc16out_data = pc16out_data;
+  frame.keypad_data = keypad_data;
+  frame.time = now;
+  frame.sequence = finished_sequence;
+  frame.sequence_sent = finished_sent;
+  finished_sequence = 0;
+  half_open = false;
+
+  if (!interruptDriven)
+    publishFrame(frame);
+  else{
+    uint8_t next = (frame_head + 1) & (PC1550_FRAME_QUEUE_SIZE - 1);
+    if (next == frame_tail)
+      diag.framesDropped++;
     else{
-      if (this->available_keypad_data != 0){
-	bKeyPressed = false;
-	this->key_released_data = available_keypad_data;
-      }
-      else if (this->available_keypad_data == 0){
-	this->key_released_data = 0;
-	bKeyPressed = false;
-	iConsecutiveKeyPressCycles = 0;	
-      }
+      frame_queue[frame_head] = frame;
+      frame_head = next;
     }
+  }
 
-    this->available_keypad_data = keypad_data;
-    this->available_controller_data = controller_data;
-    this->available_pc16out_data = this->pc16out_data;
+  //stay synchronized: the next bit after the gap starts the next cycle.
+  //If the next call to processClockCycle is delayed and that bit is
+  //missed, the bit timing in readClockEdge() will catch it
+  clearFrame();
+  gap_timed = true;
+  after_frame = true;
+}
 
-    //update iConsecutiveBeeps
-    if (!Beep()) iConsecutiveBeeps = 0;
-    else iConsecutiveBeeps++;
+//updates the available (consumer facing) state from a complete frame
+void PC1550::publishFrame(const Frame &frame){
+  if (this->available_controller_data != frame.controller_data)
+    this->bStateChanged = true;
+  else
+    this->bStateChanged = false;
+    
+  //if we received keypad_data
+  if (frame.keypad_data != 0){
+    //if it's the exact same as last time
+    if (this->available_keypad_data == frame.keypad_data){
+      bKeyPressed = false;
+      key_released_data = 0;
+      iConsecutiveKeyPressCycles++;
+    }
+    else if (this->available_keypad_data == 0){
+      bKeyPressed = true;
+      key_released_data = 0;
+      iConsecutiveKeyPressCycles = 1;
+    }
+    else if (this->available_keypad_data != 0){
+      //this is a highly unlikely state
+      //where two different key-presses occur in back to back cycles
+      //the PC1550 controller does require a cycle of no transmission
+      //between each key-press so this *should* never occur
+      bKeyPressed = true;
+      iConsecutiveKeyPressCycles = 1;
+      this->key_released_data = available_keypad_data;
+    }
+  }
+  //if keypad_data == 0
+  else{
+    if (this->available_keypad_data != 0){
+      bKeyPressed = false;
+      this->key_released_data = available_keypad_data;
+    }
+    else if (this->available_keypad_data == 0){
+      this->key_released_data = 0;
+      bKeyPressed = false;
+      iConsecutiveKeyPressCycles = 0;	
+    }
+  }
 
-    //indicate we are at the end of our transmission cycle
-    bTransmissionEnd = true;
+  //record what changed.  The beep has its own events, so it is left out
+  //of the light events
+  if (key_released_data != 0)
+    recordEvent(frame.time, KEY_RELEASE, getKeyChar(key_released_data));
+  if (bKeyPressed)
+    recordEvent(frame.time, KEY_PRESS, getKeyChar(frame.keypad_data));
+  recordBitEvents(frame.time, available_controller_data & ~0x0001,
+                  frame.controller_data & ~0x0001, LIGHT_ON);
+  if ((available_controller_data ^ frame.controller_data) & 0x0001)
+    recordEvent(frame.time, (frame.controller_data & 0x0001) ? BEEP_START : BEEP_STOP, 0);
+  recordBitEvents(frame.time, available_pc16out_data, frame.pc16out_data,
+                  PC16OUT_ON);
+  if (frame.sequence != 0)
+    recordEvent(frame.time, frame.sequence_sent ? KEYS_SENT : KEYS_FAILED,
+                frame.sequence);
+  this->keys_done = frame.sequence;
+  this->keys_done_sent = frame.sequence_sent;
+  if (frame.key_failed != 0)
+    recordEvent(frame.time, frame.key_collided ? KEY_COLLISION : KEY_MISSED,
+                getKeyChar(frame.key_failed));
 
-    //just in case the next call to processClockCycle is delayed
-    //let's assume that we lose our synchronization
-    synchronized = false;
-    controller_bits_read = 0;
+  this->controller_changed = available_controller_data ^ frame.controller_data;
+  this->pc16out_changed = available_pc16out_data ^ frame.pc16out_data;
+  this->keypad_changed = available_keypad_data ^ frame.keypad_data;
+  this->frames_published++;
+  this->frame_time = frame.time;
+
+  this->available_keypad_data = frame.keypad_data;
+  this->available_controller_data = frame.controller_data;
+  this->available_pc16out_data = frame.pc16out_data;
+
+  //the first half of this cycle is now confirmed
+  this->half_frame = frame;
+  this->half_provisional = false;
+
+  //update iConsecutiveBeeps
+  if (!Beep()) iConsecutiveBeeps = 0;
+  else iConsecutiveBeeps++;
+
+  //indicate we are at the end of our transmission cycle
+  bTransmissionEnd = true;
+}
+
+//hands the first half of a transmission cycle to the main loop, the same
+//way frameComplete() does a whole one, except that when interrupt driven
+//only the latest half is kept
+void PC1550::halfFrameComplete(unsigned long now){
+  Frame half;
+  half.controller_data = controller_data;
+  half.pc16out_data = pc16out_data;
+  half.keypad_data = keypad_data;
+  half.time = now;
+  half.sequence = 0;
+  half.sequence_sent = false;
+  half.key_failed = 0;
+  half.key_collided = false;
+
+  if (!interruptDriven)
+    publishHalfFrame(half);
+  else{
+    half_queued = half;
+    half_head++;
+    half_open = true;
   }
+}
 
-  last_clock = clock;
-}//end processClockCycle()
+//makes a first half available through halfFrame() until its frame ends
+void PC1550::publishHalfFrame(const Frame &frame){
+  this->half_frame = frame;
+  this->half_provisional = true;
+  this->bHalfFrame = true;
+}
+
+/* ==================================================================== */
+/*                           D I A G N O S T I C S                      */
+/* ==================================================================== */
+
+//the time between controller bits, as measured from the bus
+uint16_t PC1550::bitPeriodUs(){
+  return bit_period;
+}
+
+//how much longer than a bit the panel idles between transmission cycles,
+//as measured from the bus
+uint16_t PC1550::syncGapUs(){
+  return sync_gap;
+}
+
+//a consistent copy of the link health counters.  With reset, the counters
+//start over in the same step so nothing is counted twice or missed
+PC1550::Diagnostics PC1550::readDiagnostics(bool reset){
+  noInterrupts();
+  Diagnostics copy = diag;
+  if (reset){
+    memset(&diag, 0, sizeof(diag));
+    last_poll = micros();
+  }
+  interrupts();
+  return copy;
+}
+
+void PC1550::resetDiagnostics(){
+  readDiagnostics(true);
+}
+
+/* ==================================================================== */
+/*                         G L I T C H    F I L T E R                   */
+/* ==================================================================== */
+
+//for long or noisy bus wiring.  Every sample reads each line reads times
+//and takes the majority, so a spike caught by a single read is outvoted.
+//A change of the clock is only taken as an edge if it holds for most of
+//the reads over the following minPulseUs, so a glitch on the clock line
+//isn't taken for a bit, and the controller and PC16-OUT bits are voted
+//over the same reads.  The polling interval needed is unchanged, but each
+//sample costs reads times as many pin reads and each clock edge holds
+//processClockCycle() for about minPulseUs.  From interrupt capture or the
+//timer, the timer takes the later reads instead.
+void PC1550::enableGlitchFilter(uint8_t reads, uint16_t minPulseUs){
+  noInterrupts();
+  filter_reads = reads > 0 ? reads : 1;
+  filter_min_pulse = minPulseUs;
+  filtered_clock = last_clock;
+  clock_changing = false;
+  interrupts();
+}
+
+void PC1550::disableGlitchFilter(){
+  noInterrupts();
+  filter_reads = 0;
+  interrupts();
+}
+
+//adds reads reads of each line to the counts of those that were HIGH
+void PC1550::readVotes(uint8_t reads, uint8_t &clockHigh, uint8_t &dataHigh,
+                       uint8_t &pgmHigh){
+  for (uint8_t i = 0; i < reads; i++){
+    clockHigh += digitalRead(clockpin);
+    dataHigh += digitalRead(datapin);
+    pgmHigh += digitalRead(pgmpin);
+  }
+}
+
+//folds a sample of filter_reads reads of each line, of which clockHigh,
+//dataHigh and pgmHigh were HIGH, into the glitch filter and sets clock,
+//data and pgmData to the filtered levels.  Returns true while a change of
+//the clock is still being confirmed: the caller should then take another
+//sample a little later and call again
+bool PC1550::filterLines(uint8_t clockHigh, uint8_t dataHigh, uint8_t pgmHigh,
+                         unsigned long now, bool &clock, bool &data,
+                         bool &pgmData){
+  clock = clockHigh * 2 > filter_reads;
+  data = dataHigh * 2 > filter_reads;
+  pgmData = pgmHigh * 2 > filter_reads;
+
+  if (!clock_changing){
+    if (clock == filtered_clock)
+      return false;
+
+    //a change of the clock: start counting votes
+    clock_changing = true;
+    clock_change_time = now;
+    first_data = data;
+    first_pgm = pgmData;
+    votes = clock_votes = data_votes = pgm_votes = 0;
+  }
+  votes += filter_reads;
+  clock_votes += filtered_clock ? filter_reads - clockHigh : clockHigh;
+  data_votes += dataHigh;
+  pgm_votes += pgmHigh;
+
+  if (now - clock_change_time < filter_min_pulse &&
+      votes <= 255 - filter_reads)
+    return true;
+  clock_changing = false;
+
+  //a change that didn't last
+  if (clock_votes * 2 <= votes){
+    clock = filtered_clock;
+    diag.clockGlitches++;
+    return false;
+  }
+
+  //an edge.  Vote on the bits, with a tie going to the sample closest
+  //to the edge, and count the ones that needed it
+  filtered_clock = clock = !filtered_clock;
+  data = data_votes * 2 == votes ? first_data : data_votes * 2 > votes;
+  pgmData = pgm_votes * 2 == votes ? first_pgm : pgm_votes * 2 > votes;
+  if (data_votes != 0 && data_votes != votes)
+    diag.bitsCorrected++;
+  if (pgm_votes != 0 && pgm_votes != votes)
+    diag.bitsCorrected++;
+  return false;
+}
+
+/* ==================================================================== */
+/*                           E V E N T    Q U E U E                     */
+/* ==================================================================== */
+
+//adds an event unless the queue is full, in which case it is counted as
+//dropped.  The oldest events are kept since they are the ones a late
+//reader is most likely to be missing
+void PC1550::recordEvent(unsigned long time, uint8_t type, uint8_t value){
+  uint8_t next = (event_head + 1) & (PC1550_EVENT_QUEUE_SIZE - 1);
+  if (next == event_tail){
+    events_dropped++;
+    return;
+  }
+  event_queue[event_head].time = time;
+  event_queue[event_head].type = type;
+  event_queue[event_head].value = value;
+  event_head = next;
+}
+
+//records one event per bit that differs between two words, most
+//significant bit first.  onType is followed by its matching off type
+void PC1550::recordBitEvents(unsigned long time, uint16_t before,
+                             uint16_t after, uint8_t onType){
+  uint16_t changed = before ^ after;
+  for (int8_t bit = 15; changed != 0; bit--){
+    uint16_t mask = (uint16_t)1 << bit;
+    if (changed & mask){
+      recordEvent(time, (after & mask) ? onType : onType + 1, bit);
+      changed &= ~mask;
+    }
+  }
+}
+
+//the number of events waiting to be read
+uint8_t PC1550::eventsAvailable(){
+  return (event_head - event_tail) & (PC1550_EVENT_QUEUE_SIZE - 1);
+}
+
+//reads the oldest event.  Returns false if there are none
+bool PC1550::readEvent(Event &event){
+  if (event_tail == event_head)
+    return false;
+  event = event_queue[event_tail];
+  event_tail = (event_tail + 1) & (PC1550_EVENT_QUEUE_SIZE - 1);
+  return true;
+}
+
+//reads up to max events, oldest first, and returns how many were read
+uint8_t PC1550::readEvents(Event *events, uint8_t max){
+  uint8_t count = 0;
+  while (count < max && readEvent(events[count]))
+    count++;
+  return count;
+}
+
+//the number of events lost because they were not read in time
+uint16_t PC1550::eventsDropped(){
+  return events_dropped;
+}
+
+void PC1550::clearEvents(){
+  event_tail = event_head;
+}
+
+/* ==================================================================== */
+/*                        K E Y    S E Q U E N C E S                    */
+/* ==================================================================== */
+
+//marks the last key of a sequence in QueuedKey::value.  Key values only
+//use the low 7 bits
+#define KEY_LAST_IN_SEQUENCE 0x80
+
+//queues a sequence of keys (for example an access code followed by #)
+//to be sent one after the other, each as soon as the panel will accept
+//it.  Every key is held for holdCycles transmission cycles.  The whole
+//sequence is queued or, if it contains an unknown key or doesn't fit,
+//none of it is.  Returns the sequence number that the KEYS_SENT or
+//KEYS_FAILED event will carry once it is done, or 0 if it was refused.
+uint8_t PC1550::sendKeys(const char *keys, uint8_t holdCycles){
+  uint8_t length = 0;
+  while (keys[length] != '\0'){
+    if (getKeyValue(keys[length]) == 0)
+      return 0;
+    length++;
+  }
+  if (length == 0 || holdCycles == 0 ||
+      length > PC1550_KEY_QUEUE_SIZE - 1 - keysQueued())
+    return 0;
+
+  uint8_t sequence = next_sequence;
+  if (++next_sequence == 0)
+    next_sequence = 1;
+
+  //fill in the keys before moving the head, so the bus side never sees a
+  //partly written sequence
+  uint8_t head = key_queue_head;
+  for (uint8_t i = 0; i < length; i++){
+    QueuedKey &key = key_queue[head];
+    key.value = getKeyValue(keys[i]);
+    if (i == length - 1)
+      key.value |= KEY_LAST_IN_SEQUENCE;
+    key.holdCycles = holdCycles;
+    key.sequence = sequence;
+    head = (head + 1) & (PC1550_KEY_QUEUE_SIZE - 1);
+  }
+  key_queue_head = head;
+  return sequence;
+}
+
+//keys queued by sendKeys() that have not started transmitting
+uint8_t PC1550::keysQueued(){
+  return (key_queue_head - key_queue_tail) & (PC1550_KEY_QUEUE_SIZE - 1);
+}
+
+//the sendKeys() sequence that finished with the latest frame, or 0, and
+//whether every key of it was read back from the bus.  The same as the
+//KEYS_SENT and KEYS_FAILED events, for code that doesn't own the event
+//queue
+uint8_t PC1550::keysDone(){
+  return keys_done;
+}
+
+bool PC1550::keysDoneSent(){
+  return keys_done_sent;
+}
+
+//drops every queued key.  A key already being transmitted is finished,
+//but the sequences dropped this way report neither KEYS_SENT nor
+//KEYS_FAILED
+void PC1550::clearKeys(){
+  noInterrupts();
+  key_queue_tail = key_queue_head;
+  sending_sequence = 0;
+  retry_key = 0;
+  interrupts();
+}
+
+//moves the next queued key into key_to_send
+void PC1550::nextQueuedKey(){
+  QueuedKey &key = key_queue[key_queue_tail];
+  key_to_send = key.value & ~KEY_LAST_IN_SEQUENCE;
+  keyHoldCycles = key.holdCycles;
+  sending_hold = key.holdCycles;
+  key_retries_left = PC1550_KEY_RETRIES;
+  key_first_cycle = true;
+  sending_sequence = key.sequence;
+  sending_last = (key.value & KEY_LAST_IN_SEQUENCE) != 0;
+  key_queue_tail = (key_queue_tail + 1) & (PC1550_KEY_QUEUE_SIZE - 1);
+}
+
+//settles a cycle in which we sent a key.  A key not read back from the bus
+//intact in its first cycle (the one the panel takes it in) is sent again
+//from the start, up to PC1550_KEY_RETRIES times; once the panel has it,
+//sending it again would press it twice.  A sequence is done once its last
+//key has been confirmed for all of its hold cycles; a key that fails for
+//good fails the sequence and drops the rest of it
+void PC1550::keyResult(bool confirmed){
+  bool first = key_first_cycle;
+  key_first_cycle = false;
+
+  if (!confirmed){
+    key_to_send = 0;
+    keyHoldCycles = 0;
+    if (first && key_retries_left > 0){
+      key_retries_left--;
+      retry_key = key_sent;
+      diag.keyRetries++;
+      return;
+    }
+  }
+  if (sending_sequence == 0)
+    return;
+
+  if (!confirmed){
+    while (key_queue_tail != key_queue_head &&
+           key_queue[key_queue_tail].sequence == sending_sequence)
+      key_queue_tail = (key_queue_tail + 1) & (PC1550_KEY_QUEUE_SIZE - 1);
+  }
+  else if (!sending_last || key_to_send != 0)
+    return;
+
+  finished_sequence = sending_sequence;
+  finished_sent = confirmed;
+  sending_sequence = 0;
+}
+
+/* ==================================================================== */
+/*                          B U S    T R A C I N G                      */
+/* ==================================================================== */
+
+//every line sample taken by processClockCycle() or the interrupt handler
+//is passed to the recorder, which keeps only the changes
+void PC1550::attachRecorder(PC1550TraceWriter *recorder){
+  noInterrupts();
+  this->recorder = recorder;
+  interrupts();
+}
+
+void PC1550::traceLines(bool clock, bool data, bool pgmData,
+                        unsigned long now){
+  if (recorder != 0)
+    recorder->sample(clock, data, pgmData, now);
+}
+
+/* ==================================================================== */
+/*              I N T E R R U P T    D R I V E N    C A P T U R E       */
+/* ==================================================================== */
+
+PC1550 *PC1550::interruptInstance = 0;
+
+//Attaches an interrupt to every change of the clock line so that bits are
+//captured no matter how long the loop() function takes.  Completed frames
+//are queued and then published by processClockCycle().
+//
+//Pins with an external interrupt (pins 2 and 3 on the UNO) are attached
+//directly.  On other AVR pins the pin change interrupt is enabled, but
+//since other libraries (SoftwareSerial, for one) also define the pin change
+//vectors, the sketch must forward the vector for the clock pin itself:
+//
+//    ISR(PCINT1_vect){ PC1550::clockInterrupt(); }   //A0-A5 on the UNO
+//
+//The keypad needs time to drive the line after the clock falls, and the
+//glitch filter has to see a change of the clock last.  Rather than wait in
+//the handler, it leaves the edge for the next processClockCycle() to
+//finish once enough time has passed (a keypad bit it is too late for is
+//taken from the last sample before the clock rose).  With useTimer it
+//runs the sampling timer once instead (Timer2 on the AVR, see
+//enableTimerSampling()) and finishes the edge from timerInterrupt(), so
+//loop() can take as long as it likes.  That timer can't be shared with
+//tone(), and the sketch must forward its vector too or the AVR resets
+//when it fires:
+//
+//    ISR(TIMER2_COMPA_vect){ PC1550::timerInterrupt(); }
+//
+//useTimer is ignored on boards without the timer.  Only one instance can
+//be interrupt driven at a time.  Returns false if the clock pin cannot
+//raise an interrupt.
+bool PC1550::enableInterruptCapture(bool useTimer){
+  disableTimerSampling();
+#if defined(ARDUINO) && !(defined(__AVR__) && defined(TCCR2A))
+  useTimer = false;
+#endif
+  if (interruptDriven){
+    noInterrupts();
+    if (capture_timed && !useTimer){
+      stopTimer();
+      settling = false;
+    }
+    capture_timed = useTimer;
+    interrupts();
+    return true;
+  }
+
+  int irq = digitalPinToInterrupt(clockpin);
+#if defined(__AVR__)
+  volatile uint8_t *pcmsk = digitalPinToPCMSK(clockpin);
+  if (irq == NOT_AN_INTERRUPT && pcmsk == 0)
+    return false;
+#else
+  if (irq == NOT_AN_INTERRUPT)
+    return false;
+#endif
+
+  if (interruptInstance != 0 && interruptInstance != this)
+    interruptInstance->disableInterruptCapture();
+
+  noInterrupts();
+  interruptInstance = this;
+  interruptDriven = true;
+  capture_timed = useTimer;
+  frame_head = 0;
+  frame_tail = 0;
+  last_clock = digitalRead(clockpin);
+  filtered_clock = last_clock;
+  clock_changing = false;
+  keypad_sample_pending = false;
+  settling = false;
+  synchronized = false;
+  controller_bits_read = 0;
+  interrupts();
+
+  if (irq != NOT_AN_INTERRUPT)
+    attachInterrupt(irq, clockInterrupt, CHANGE);
+#if defined(__AVR__)
+  else{
+    *pcmsk |= _BV(digitalPinToPCMSKbit(clockpin));
+    PCIFR |= _BV(digitalPinToPCICRbit(clockpin));
+    PCICR |= _BV(digitalPinToPCICRbit(clockpin));
+  }
+#endif
+  return true;
+}
+
+//returns to polled operation.  Any queued frames are discarded.
+void PC1550::disableInterruptCapture(){
+  if (timerDriven)
+    disableTimerSampling();
+  if (!interruptDriven)
+    return;
+
+  int irq = digitalPinToInterrupt(clockpin);
+  if (irq != NOT_AN_INTERRUPT)
+    detachInterrupt(irq);
+#if defined(__AVR__)
+  else
+    *digitalPinToPCMSK(clockpin) &= ~_BV(digitalPinToPCMSKbit(clockpin));
+#endif
+
+  noInterrupts();
+  if (capture_timed)
+    stopTimer();
+  capture_timed = false;
+  interruptDriven = false;
+  if (interruptInstance == this)
+    interruptInstance = 0;
+  frame_tail = frame_head;
+  synchronized = false;
+  controller_bits_read = 0;
+  interrupts();
+}
+
+bool PC1550::interruptCaptureEnabled(){
+  return interruptDriven;
+}
+
+//the number of completed frames waiting for processClockCycle()
+uint8_t PC1550::framesQueued(){
+  return (frame_head - frame_tail) & (PC1550_FRAME_QUEUE_SIZE - 1);
+}
+
+//the number of frames lost because processClockCycle() was not called
+//often enough to keep the frame queue from filling up
+uint16_t PC1550::framesDropped(){
+  noInterrupts();
+  uint16_t dropped = diag.framesDropped;
+  interrupts();
+  return dropped;
+}
+
+//called on every change of the clock line.  This is attached automatically
+//by enableInterruptCapture(), or can be called from the sketch's own pin
+//change vector.
+void PC1550::clockInterrupt(){
+  PC1550 *panel = interruptInstance;
+  if (panel == 0 || !panel->interruptDriven || panel->timerDriven)
+    return;
+  panel->wakeUp();
+
+  //a change of the clock being confirmed is sampled by the timer
+  if (panel->clock_changing)
+    return;
+  panel->captureLines(false);
+}
+
+//reads the lines for interrupt capture, on a change of the clock or when
+//the timer run for an earlier one (timed) is up
+void PC1550::captureLines(bool timed){
+  boolean clock = digitalRead(clockpin);
+  boolean data = digitalRead(datapin);
+  boolean pgmData = digitalRead(pgmpin);
+  unsigned long now = micros();
+
+  //vote on the reads, and sample a change again until it has lasted the
+  //minimum pulse
+  if (filter_reads > 0){
+    uint8_t clockHigh = clock, dataHigh = data, pgmHigh = pgmData;
+    readVotes(filter_reads - 1, clockHigh, dataHigh, pgmHigh);
+    if (filterLines(clockHigh, dataHigh, pgmHigh, now,
+                    clock, data, pgmData)){
+      settling = false;
+      if (capture_timed)
+        startTimer((filter_min_pulse + 1) / 2);
+      return;
+    }
+  }
+
+  //a pin change vector is shared by several pins, so ignore anything
+  //that is not a change of the clock
+  if (clock != last_clock){
+    traceLines(clock, data, pgmData, now);
+
+    //no edges are missed in this mode, so any bit that follows an idle
+    //clock longer than a cycle ever has is the first bit of a new
+    //transmission cycle
+    if (clock && now - last_read > syncIdleUs())
+      resetFrame();
+
+    driveBus(readClockEdge(clock, data, pgmData, now));
+    settling = false;
+  }
+
+  //nothing calls back into the decoder before the next edge, so the
+  //keypad bit is sampled once the timer (or processClockCycle()) has
+  //waited for it to settle
+  if (!keypad_sample_pending)
+    return;
+  unsigned long waited = now - keypad_edge_time;
+  if ((timed && settling) || waited >= PC1550_KEYPAD_SETTLE_US){
+    settling = false;
+    keypad_sample_pending = false;
+    keypadBit(data);
+  }
+  else
+    settling = capture_timed && startTimer(PC1550_KEYPAD_SETTLE_US - waited);
+}
+
+/* ==================================================================== */
+/*                   T I M E R    D R I V E N    S A M P L I N G        */
+/* ==================================================================== */
+
+//Samples the bus from a hardware timer interrupt every periodUs, exactly
+//as a loop() calling processClockCycle() at that rate would, so the time
+//taken by the decoder is the same every period however long loop() takes.
+//Completed frames are queued and published by processClockCycle() as
+//with interrupt capture, and keys are sent from the timer interrupt.
+//
+//On AVR boards this uses Timer2 (which tone() also uses) with a 4us
+//resolution, so periodUs can be 4 to 1024.  As with the pin change
+//vectors, the sketch forwards the vector itself:
+//
+//    ISR(TIMER2_COMPA_vect){ PC1550::timerInterrupt(); }
+//
+//Only one instance can be interrupt driven at a time, whether by the
+//clock pin or the timer.  Returns false if the board has no timer
+//support or the period is out of range.
+bool PC1550::enableTimerSampling(uint16_t periodUs){
+#if defined(__AVR__) && defined(TCCR2A)
+  if (periodUs < 4 || periodUs > 1024)
+    return false;
+#elif defined(ARDUINO)
+  (void)periodUs;
+  return false;
+#else
+  if (periodUs == 0)
+    return false;
+#endif
+
+  disableInterruptCapture();
+  if (interruptInstance != 0 && interruptInstance != this)
+    interruptInstance->disableInterruptCapture();
+
+  noInterrupts();
+  interruptInstance = this;
+  interruptDriven = true;
+  timerDriven = true;
+  frame_head = 0;
+  frame_tail = 0;
+  synchronized = false;
+  controller_bits_read = 0;
+  last_read = micros();
+  timer_period = periodUs;
+  sampling_sooner = false;
+  startTimer(periodUs);
+  interrupts();
+  return true;
+}
+
+//stops the timer and returns to polled operation.  Any queued frames are
+//discarded.
+void PC1550::disableTimerSampling(){
+  if (!timerDriven)
+    return;
+
+  noInterrupts();
+  stopTimer();
+  timerDriven = false;
+  interruptDriven = false;
+  if (interruptInstance == this)
+    interruptInstance = 0;
+  frame_tail = frame_head;
+  synchronized = false;
+  controller_bits_read = 0;
+  interrupts();
+}
+
+bool PC1550::timerSamplingEnabled(){
+  return timerDriven;
+}
+
+//called every sampling period by the timer, or once when interrupt
+//capture ran it to finish an edge
+void PC1550::timerInterrupt(){
+  PC1550 *panel = interruptInstance;
+  if (panel == 0 || !panel->interruptDriven)
+    return;
+  panel->wakeUp();
+  if (panel->timerDriven)
+    panel->sampleBus(micros());
+  else{
+    stopTimer();
+    panel->captureLines(true);
+  }
+}
+
+//runs timerInterrupt() every us (at a 4us resolution, up to 1024us, on the
+//AVR) from now.  Returns false if the board has no timer support
+bool PC1550::startTimer(uint16_t us){
+#if defined(__AVR__) && defined(TCCR2A)
+  uint16_t ticks = (us + 3) / 4;
+  if (ticks == 0)
+    ticks = 1;
+  else if (ticks > 256)
+    ticks = 256;
+
+  //CTC mode, counting 4us ticks: clock/64 at 16MHz, clock/32 at 8MHz
+  TCCR2A = _BV(WGM21);
+#if F_CPU >= 16000000L
+  TCCR2B = _BV(CS22);
+#else
+  TCCR2B = _BV(CS21) | _BV(CS20);
+#endif
+  OCR2A = ticks - 1;
+  TCNT2 = 0;
+  TIFR2 = _BV(OCF2A);
+  TIMSK2 |= _BV(OCIE2A);
+  return true;
+#elif defined(ARDUINO)
+  (void)us;
+  return false;
+#else
+  PC1550StartTimer(us > 0 ? us : 1, timerInterrupt);
+  return true;
+#endif
+}
+
+void PC1550::stopTimer(){
+#if defined(__AVR__) && defined(TCCR2A)
+  TIMSK2 &= ~_BV(OCIE2A);
+#elif !defined(ARDUINO)
+  PC1550StopTimer();
+#endif
+}
+
+/* ==================================================================== */
+/*                          L O W    P O W E R                          */
+/* ==================================================================== */
+
+//Puts the processor to sleep until the next interrupt, for sketches that
+//run from the panel's battery.  With interrupt capture or timer sampling
+//enabled the bus needs no attention between edges (or samples), so loop()
+//can sleep through them and through the gap between cycles:
+//
+//    void loop(){
+//      alarm.processClockCycle();
+//      ...
+//      alarm.sleepUntilEdge();
+//    }
+//
+//The clock pin change, the sampling timer or any other interrupt (millis()
+//on the AVR wakes it every 1ms) ends the sleep.  On the AVR this is the
+//IDLE sleep mode, which keeps the timers and pin change interrupts
+//running.  On the host the backend decides what sleeping means (see
+//PC1550Backend::sleepUntilInterrupt()).
+//
+//Returns false without sleeping when the bus is polled, when a frame is
+//already waiting for processClockCycle() or an edge is waiting for it to
+//finish (interrupt capture without the timer), or on boards without sleep
+//support.
+bool PC1550::sleepUntilEdge(){
+#if defined(ARDUINO) && !defined(__AVR__)
+  return false;
+#else
+  if (!interruptDriven)
+    return false;
+
+  unsigned long start = micros();
+  noInterrupts();
+  if (frame_head != frame_tail || (half_open && half_tail != half_head) ||
+      (!timerDriven && !capture_timed &&
+       (keypad_sample_pending || clock_changing))){
+    interrupts();
+    return false;
+  }
+  sleeping = true;
+
+#if defined(__AVR__)
+  //sei always runs the next instruction before any interrupt, so an
+  //edge can't slip in between enabling interrupts and sleeping
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  interrupts();
+  sleep_cpu();
+  sleep_disable();
+#else
+  interrupts();
+  PC1550Sleep();
+#endif
+
+  //woken by something other than the bus, or not at all
+  noInterrupts();
+  unsigned long woke = sleeping ? micros() : woke_at;
+  sleeping = false;
+  asleep_us += woke - start;
+  sleeps++;
+  interrupts();
+  return true;
+#endif
+}
+
+//called first thing by the interrupt handlers: the time the processor
+//spends on the bus counts as awake
+void PC1550::wakeUp(){
+  if (sleeping){
+    woke_at = micros();
+    sleeping = false;
+  }
+}
+
+//the time spent awake and asleep since the stats were last reset (or the
+//PC1550 was constructed).  micros() wraps after about 70 minutes, so read
+//them with reset more often than that
+PC1550::PowerStats PC1550::readPowerStats(bool reset){
+  unsigned long now = micros();
+  noInterrupts();
+  PowerStats stats;
+  unsigned long elapsed = now - power_since;
+  stats.asleepUs = asleep_us;
+  stats.sleeps = sleeps;
+  if (reset){
+    power_since = now;
+    asleep_us = 0;
+    sleeps = 0;
+  }
+  interrupts();
+
+  stats.awakeUs = elapsed > stats.asleepUs ? elapsed - stats.asleepUs : 0;
+  if (elapsed >= 1000)
+    stats.dutyCycle = stats.awakeUs / (elapsed / 1000);
+  else
+    stats.dutyCycle = 1000;
+  if (stats.dutyCycle > 1000)
+    stats.dutyCycle = 1000;
+  return stats;
+}
+
+void PC1550::resetPowerStats(){
+  readPowerStats(true);
+}
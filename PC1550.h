@@ -1,16 +1,221 @@
 #ifndef DSC_PC1550_H
 #define DSC_PC1550_H
 
-#if ARDUINO >= 100
+#if defined(ARDUINO) && ARDUINO >= 100
 #include <Arduino.h> // Arduino 1.0
-#else
+#elif defined(ARDUINO)
 #include <Wprogram.h> // Arduino 0022
+#else
+#include "PC1550Host.h" // host builds, see extras/host
 #endif
 
 #include <stdint.h>
 
+//number of completed frames the interrupt handler can queue before the
+//main loop has to drain them (must be a power of two)
+#ifndef PC1550_FRAME_QUEUE_SIZE
+#define PC1550_FRAME_QUEUE_SIZE 4
+#endif
+
+//how long the data line is given to settle after the clock changes before
+//the bit a keypad is driving is sampled
+#ifndef PC1550_KEYPAD_SETTLE_US
+#define PC1550_KEYPAD_SETTLE_US 100
+#endif
+
+//glitch filter defaults: reads of each line per sample, and the shortest
+//clock pulse taken as a real edge
+#ifndef PC1550_FILTER_READS
+#define PC1550_FILTER_READS 3
+#endif
+#ifndef PC1550_FILTER_MIN_PULSE_US
+#define PC1550_FILTER_MIN_PULSE_US 20
+#endif
+
+//how much earlier than predicted nextEdgeDueUs() asks to be called, to
+//allow for the panel's timing wandering
+#ifndef PC1550_EDGE_MARGIN_US
+#define PC1550_EDGE_MARGIN_US 100
+#endif
+
+//how often enableTimerSampling() samples the bus by default
+#ifndef PC1550_TIMER_SAMPLE_US
+#define PC1550_TIMER_SAMPLE_US 200
+#endif
+
+class PC1550TraceWriter;
+
+//the longest the clock stays idle within a transmission cycle, with
+//plenty of margin.  Anything longer is the gap between cycles
+#define PC1550_BIT_GAP_US 10000
+
+//the panel's nominal timing, which the decoder starts from and then
+//refines by measuring the bus: the time between controller bits, and the
+//extra idle time between transmission cycles
+#define PC1550_BIT_PERIOD_US 1550
+#define PC1550_SYNC_GAP_US 26500
+
+//gaps between transmission cycles outside this range are counted by the
+//link health counters, see Diagnostics
+#ifndef PC1550_SYNC_GAP_MIN_US
+#define PC1550_SYNC_GAP_MIN_US 25000
+#endif
+#ifndef PC1550_SYNC_GAP_MAX_US
+#define PC1550_SYNC_GAP_MAX_US 28000
+#endif
+
+//number of events held for readEvents() before new ones are dropped
+//(must be a power of two)
+#ifndef PC1550_EVENT_QUEUE_SIZE
+#define PC1550_EVENT_QUEUE_SIZE 16
+#endif
+
+//number of keys sendKeys() can hold before it refuses a sequence
+//(must be a power of two)
+#ifndef PC1550_KEY_QUEUE_SIZE
+#define PC1550_KEY_QUEUE_SIZE 16
+#endif
+
+//times a key we send that isn't read back intact (another keypad pressed
+//at the same moment, say) is sent again before it is given up on
+#ifndef PC1550_KEY_RETRIES
+#define PC1550_KEY_RETRIES 3
+#endif
+
 class PC1550 {
 
+ public:
+  //the kinds of event recorded for readEvents()
+  enum EventType {
+    LIGHT_ON,     //value is the controller bit (15 = zone 1 ... 3 = trouble)
+    LIGHT_OFF,
+    KEY_PRESS,    //value is the key character
+    KEY_RELEASE,
+    BEEP_START,   //value is unused
+    BEEP_STOP,
+    PC16OUT_ON,   //value is the PC16-OUT bit (0 = PGM output ... 15 = zone 1)
+    PC16OUT_OFF,
+    KEYS_SENT,    //value is the sequence number returned by sendKeys()
+    KEYS_FAILED,
+    KEY_COLLISION, //value is the key character we sent
+    KEY_MISSED
+  };
+
+  //a change seen on the bus and the micros() time of the frame it was in
+  struct Event {
+    unsigned long time;
+    uint8_t type;
+    uint8_t value;
+  };
+
+  //bits of Snapshot::controller (the keypad lights)
+  enum {
+    ZONE1_LIGHT   = 0x8000,
+    ZONE2_LIGHT   = 0x4000,
+    ZONE3_LIGHT   = 0x2000,
+    ZONE4_LIGHT   = 0x1000,
+    ZONE5_LIGHT   = 0x0800,
+    ZONE6_LIGHT   = 0x0400,
+    READY_LIGHT   = 0x0080,
+    ARMED_LIGHT   = 0x0040,
+    MEMORY_LIGHT  = 0x0020,
+    BYPASS_LIGHT  = 0x0010,
+    TROUBLE_LIGHT = 0x0008,
+    BEEPING       = 0x0001
+  };
+
+  //bits of Snapshot::pc16out (the PC16-OUT outputs)
+  enum {
+    PGM_OUTPUT        = 0x0001,
+    FIRE_BUTTON       = 0x0002,
+    AUX_BUTTON        = 0x0004,
+    PANIC_BUTTON      = 0x0008,
+    SYSTEM_ARMED      = 0x0030,
+    ARMED_WITH_BYPASS = 0x0040,
+    SYSTEM_TROUBLE    = 0x0080,
+    FIRE_ALARM        = 0x0100,
+    ZONE6_TRIPPED     = 0x0400,
+    ZONE5_TRIPPED     = 0x0800,
+    ZONE4_TRIPPED     = 0x1000,
+    ZONE3_TRIPPED     = 0x2000,
+    ZONE2_TRIPPED     = 0x4000,
+    ZONE1_TRIPPED     = 0x8000,
+    ALARM_TRIPPED     = 0xFC00
+  };
+
+  //the whole of the latest transmission cycle, see snapshot()
+  struct Snapshot {
+    uint16_t controller;         //light bits, ZONE1_LIGHT ... BEEPING
+    uint16_t pc16out;            //PC16-OUT bits, PGM_OUTPUT ... ZONE1_TRIPPED
+    uint8_t keypad;              //raw key bits on the bus, 0 for none
+    char key;                    //...as a key character, '\0' for none
+    uint16_t controllerChanged;  //bits that differ from the previous frame
+    uint16_t pc16outChanged;
+    uint8_t keypadChanged;
+    uint16_t consecutiveBeeps;
+    uint16_t consecutiveKeyPresses;
+    uint32_t sequence;           //frames published so far
+    unsigned long time;          //micros() when the frame ended
+  };
+
+  //the first half of a transmission cycle, see halfFrame()
+  struct HalfFrame {
+    uint8_t lights;              //zone lights, ZONE1_LIGHT >> 8 ...
+    uint8_t tripped;             //PC16-OUT zones, ZONE1_TRIPPED >> 8 ...
+    uint8_t keypad;              //raw key bits on the bus, 0 for none
+    char key;                    //...as a key character, '\0' for none
+    bool provisional;            //true until the rest of the cycle is read
+    unsigned long time;          //micros() when it was read
+  };
+
+  //link health counters, see readDiagnostics()
+  struct Diagnostics {
+    uint32_t framesDecoded;      //complete frames read from the bus
+    uint16_t framesAbandoned;    //frames started but never completed
+    uint16_t framesDropped;      //frames lost from a full interrupt queue
+    uint16_t resyncs;            //syncs that didn't follow a decoded frame
+    uint16_t syncGapsMissed;     //gaps not watched closely enough to sync
+    uint16_t syncGapsOutOfRange; //gaps after a frame outside the range
+    uint16_t keysSent;           //cycles in which we sent a key
+    uint16_t keysConfirmed;      //...and read exactly that key back
+    uint16_t keyCollisions;      //...or read it back with another's bits
+    uint16_t keysMissed;         //...or read it back with bits missing
+    uint16_t keyRetries;         //keys sent again after one of those
+    uint16_t lateKeypadSamples;  //keypad bits sampled before settling
+    uint16_t bitsCorrected;      //bits the glitch filter outvoted
+    uint16_t clockGlitches;      //clock pulses the glitch filter ignored
+    unsigned long maxPollGapUs;  //longest time between processClockCycle()s
+  };
+
+  //where the time went, see sleepUntilEdge()
+  struct PowerStats {
+    unsigned long awakeUs;       //time the processor was running
+    unsigned long asleepUs;      //...and asleep in sleepUntilEdge()
+    uint32_t sleeps;             //times it went to sleep
+    uint16_t dutyCycle;          //awake time in tenths of a percent
+  };
+
+ private:
+  //one complete transmission cycle as captured from the bus
+  struct Frame {
+    uint16_t controller_data;
+    uint16_t pc16out_data;
+    uint8_t keypad_data;
+    unsigned long time;
+    uint8_t sequence;       //a sendKeys() sequence that finished, or 0
+    bool sequence_sent;     //...and whether every key was confirmed
+    uint8_t key_failed;     //a key we sent that wasn't read back intact
+    bool key_collided;      //...because another keypad's bits were on it
+  };
+
+  //a key waiting in the sendKeys() queue.  The last key of a sequence
+  //has KEY_LAST_IN_SEQUENCE set in its value
+  struct QueuedKey {
+    uint8_t value;
+    uint8_t holdCycles;
+    uint8_t sequence;
+  };
+
   uint8_t datapin;
   uint8_t clockpin;
   uint8_t pgmpin;
@@ -40,6 +245,13 @@ class PC1550 {
   //the keypad bits that have been read so far in the transmission cycle
   uint8_t keypad_data;
 
+  //set when a keypad bit is due but the line has not settled yet, the
+  //time the clock edge that started it was seen, and the latest
+  //(possibly unsettled) level of the data line since then
+  bool keypad_sample_pending;
+  unsigned long keypad_edge_time;
+  bool keypad_sample;
+
   //the last set of keypad data completely read
   uint8_t available_keypad_data;
 
@@ -64,11 +276,20 @@ class PC1550 {
   //the last time the clock was low
   unsigned long last_read;
 
+  //set when that was the last bit of a frame we read, so the next cycle
+  //is due a bit period and the sync gap after it.  After any other sync
+  //the gap could end at any moment
+  bool gap_timed;
+
+  //set from the last bit of a frame we read until the first bit after the
+  //gap, whose time gives the gap's length
+  bool after_frame;
+
   //the last time we checked, was the clock high or low?
   bool last_clock;
 
   //number of cycles without a keypress
-  uint8_t cyclesWithoutKey;
+  volatile uint8_t cyclesWithoutKey;
 
   //whether or not we should be transmitting key bits
   bool transmitting;
@@ -77,11 +298,45 @@ class PC1550 {
   //the Fire key (F), for example, only works if held for a few seconds
   //this variable indicates for how many more cycles we should
   //send the key
-  uint8_t keyHoldCycles;
+  volatile uint8_t keyHoldCycles;
 
   //the next byte of data we should transmit to the control panel
   //the value is set to zero once succesfully sent
-  uint8_t key_to_send;
+  volatile uint8_t key_to_send;
+
+  //keys queued by sendKeys().  The main loop is the only writer of
+  //key_queue_head; the bus side (possibly the interrupt handler) is the
+  //only writer of key_queue_tail
+  QueuedKey key_queue[PC1550_KEY_QUEUE_SIZE];
+  volatile uint8_t key_queue_head;
+  volatile uint8_t key_queue_tail;
+
+  //the number the next sendKeys() sequence will be given
+  uint8_t next_sequence;
+
+  //the sequence key_to_send came from (0 for sendKey()), and whether it
+  //is that sequence's last key
+  uint8_t sending_sequence;
+  bool sending_last;
+
+  //the hold cycles key_to_send started with, the retries it has left, and
+  //whether its first cycle is yet to be checked.  A key to be sent again
+  //waits in retry_key, ahead of anything queued, for a cycle after one in
+  //which the bus carried no key at all (bus_keypad_data is the last
+  //cycle's keypad byte)
+  uint8_t sending_hold;
+  uint8_t key_retries_left;
+  bool key_first_cycle;
+  volatile uint8_t retry_key;
+  volatile uint8_t bus_keypad_data;
+
+  //a sequence that finished and has not been handed to a frame yet
+  uint8_t finished_sequence;
+  bool finished_sent;
+
+  //the sequence that finished with the latest published frame, if any
+  uint8_t keys_done;
+  bool keys_done_sent;
 
   //the number of bits we have sent to the control panel from keyCodeToSend
   uint8_t keypad_bits_sent;
@@ -93,14 +348,201 @@ class PC1550 {
   //and only when finished reading all 16 bits
   bool bTransmissionEnd;
 
+  //set when edges are captured by the clock pin interrupt rather than
+  //by polling processClockCycle()
+  bool interruptDriven;
+
+  //set (along with interruptDriven) when the bus is sampled from a timer
+  //interrupt
+  bool timerDriven;
+
+  //set when interrupt capture may run the timer once to finish an edge,
+  //see enableInterruptCapture()
+  bool capture_timed;
+
+  //set when interrupt capture has the timer running once to wait out a
+  //keypad bit's settling time (rather than to confirm a clock change)
+  bool settling;
+
+  //the timer sampling period, and set while the timer samples sooner than
+  //that to confirm a change of the clock
+  uint16_t timer_period;
+  bool sampling_sooner;
+
+  //frames completed by the interrupt handler and not yet published.
+  //the interrupt handler is the only writer of frame_head and the main
+  //loop is the only writer of frame_tail, so no locking is needed
+  Frame frame_queue[PC1550_FRAME_QUEUE_SIZE];
+  volatile uint8_t frame_head;
+  volatile uint8_t frame_tail;
+
+  //the first half of the cycle being read, once it is complete.  When
+  //interrupt driven the handler fills half_queued and bumps half_head,
+  //and half_open stays set until the rest of the cycle is read or lost.
+  //Only the handler writes these three
+  Frame half_queued;
+  volatile uint8_t half_head;
+  volatile bool half_open;
+
+  //the last half_head published by the main loop
+  uint8_t half_tail;
+
+  //the first half as published, whether the rest of its cycle is still
+  //to come, and true for one execution of processClockCycle after it is
+  //published
+  Frame half_frame;
+  bool half_provisional;
+  bool bHalfFrame;
+
+  //link health counters, updated from the interrupt handler when
+  //interrupt driven
+  Diagnostics diag;
+
+  //when processClockCycle() was last called
+  unsigned long last_poll;
+
+  //power accounting for sleepUntilEdge(): since when, and the time spent
+  //asleep and how often.  While sleeping is set, the interrupt handler
+  //that wakes the processor records when in woke_at
+  unsigned long power_since;
+  unsigned long asleep_us;
+  uint32_t sleeps;
+  volatile bool sleeping;
+  volatile unsigned long woke_at;
+
+  //the measured bit period and sync gap (see bitPeriodUs())
+  uint16_t bit_period;
+  uint16_t sync_gap;
+
+  //since when the clock has been watched idle, with samples close enough
+  //together that no bit could have slipped between them, and the time of
+  //the previous sample
+  unsigned long idle_since;
+  unsigned long last_sample;
+
+  //the key transmitted in the current cycle, if any
+  uint8_t key_sent;
+
+  //changes recorded by publishFrame() and not yet read.  Both ends are
+  //only ever touched from the main loop
+  Event event_queue[PC1550_EVENT_QUEUE_SIZE];
+  uint8_t event_head;
+  uint8_t event_tail;
+
+  //events lost because the event queue was full
+  uint16_t events_dropped;
+
+  //what changed in the latest frame, how many frames have been published
+  //and when the latest one ended
+  uint16_t controller_changed;
+  uint16_t pc16out_changed;
+  uint8_t keypad_changed;
+  uint32_t frames_published;
+  unsigned long frame_time;
+
+  //receives every line sample when a trace is being recorded
+  PC1550TraceWriter *recorder;
+
+  //polls buses on behalf of several PC1550s at once
+  friend class PC1550Scanner;
+
+  //reads the flags publishFrame() leaves without a call, see below
+  template <class Handlers, class Base> friend class PC1550Events;
+
+  //the glitch filter's clock level.  While a change of it is being
+  //confirmed: when it was first seen, the first sample's data and PGM
+  //levels, and the reads taken since (with those at the new clock level
+  //and those HIGH)
+  bool filtered_clock;
+  bool clock_changing;
+  unsigned long clock_change_time;
+  bool first_data;
+  bool first_pgm;
+  uint8_t votes;
+  uint8_t clock_votes;
+  uint8_t data_votes;
+  uint8_t pgm_votes;
+
+  //the instance serviced by clockInterrupt()
+  static PC1550 *interruptInstance;
+
   static char getKeyChar(uint8_t value);
   uint8_t getKeyValue(char key);
+  void resetFrame();
+  void loseSync();
+  void clearFrame();
+  void sampleBus(unsigned long now);
+  void captureLines(bool timed);
+  static bool startTimer(uint16_t us);
+  static void stopTimer();
+  void frameComplete(unsigned long now);
+  void publishFrame(const Frame &frame);
+  void halfFrameComplete(unsigned long now);
+  void publishHalfFrame(const Frame &frame);
+  void recordEvent(unsigned long time, uint8_t type, uint8_t value);
+  void recordBitEvents(unsigned long time, uint16_t before, uint16_t after,
+                       uint8_t onType);
+  void driveBus(uint8_t actions);
+  void keypadBit(bool dataLine);
+  void readVotes(uint8_t reads, uint8_t &clockHigh, uint8_t &dataHigh,
+                 uint8_t &pgmHigh);
+  void nextQueuedKey();
+  void keyResult(bool confirmed);
+  void wakeUp();
+
+ protected:
+  //bus actions returned by readClockEdge()
+  enum {
+    RELEASE_DATA  = 0x01, //let the data line float (pinMode INPUT)
+    DRIVE_DATA    = 0x02  //pull the data line low (pinMode OUTPUT)
+  };
+
+  //building blocks of processClockCycle() for variants that do their own
+  //pin I/O (see PC1550Fast below)
+  bool startClockCycle(unsigned long now);
+  void checkSyncGap(bool clock, unsigned long now);
+  uint8_t readClockEdge(bool clock, bool data, bool pgmData,
+                        unsigned long now);
+  void traceLines(bool clock, bool data, bool pgmData, unsigned long now);
+  unsigned long syncIdleUs();
+  bool pollWait(unsigned long start, unsigned long maxMicros,
+                unsigned long &due);
+  bool filterLines(uint8_t clockHigh, uint8_t dataHigh, uint8_t pgmHigh,
+                   unsigned long now, bool &clock, bool &data, bool &pgmData);
+
+  //glitch filter settings, see enableGlitchFilter().  0 reads is off
+  uint8_t filter_reads;
+  uint16_t filter_min_pulse;
 
  public:
   PC1550(uint8_t datapin = A3, uint8_t clockpin = A4, uint8_t pgmpin = A1);
   void processClockCycle();
   void processTransmissionCycle();
 
+  //cooperative polling
+  unsigned long poll(unsigned long maxMicros = 0);
+  unsigned long nextEdgeDueUs();
+
+  //interrupt driven capture
+  //with useTimer, the sketch must forward TIMER2_COMPA_vect on the AVR
+  bool enableInterruptCapture(bool useTimer = false);
+  void disableInterruptCapture();
+  bool interruptCaptureEnabled();
+  uint8_t framesQueued();
+  uint16_t framesDropped();
+  static void clockInterrupt();
+
+  //timer driven sampling
+  bool enableTimerSampling(uint16_t periodUs = PC1550_TIMER_SAMPLE_US);
+  void disableTimerSampling();
+  bool timerSamplingEnabled();
+  static void timerInterrupt();
+
+  //low power operation between interrupts
+  bool sleepUntilEdge();
+  PowerStats readPowerStats(bool reset = false);
+  void resetPowerStats();
+
   //keypad emulation and status
   bool keypadStateChanged();
   char keyPressed();
@@ -120,8 +562,41 @@ class PC1550 {
   uint16_t consecutiveBeeps();
   uint16_t consecutiveKeyPresses();
   bool atTransmissionEnd();
+  bool atHalfFrame();
+  HalfFrame halfFrame();
   bool readyForKeyPress();
   bool sendKey(char c, uint8_t holdCycles = 1);
+  Snapshot snapshot();
+
+  //queued key sequences
+  uint8_t sendKeys(const char *keys, uint8_t holdCycles = 1);
+  uint8_t keysQueued();
+  void clearKeys();
+  uint8_t keysDone();
+  bool keysDoneSent();
+
+  //buffered, timestamped changes
+  uint8_t eventsAvailable();
+  bool readEvent(Event &event);
+  uint8_t readEvents(Event *events, uint8_t max);
+  uint16_t eventsDropped();
+  void clearEvents();
+
+  //bus timing as measured by the decoder
+  uint16_t bitPeriodUs();
+  uint16_t syncGapUs();
+
+  //link health
+  Diagnostics readDiagnostics(bool reset = false);
+  void resetDiagnostics();
+
+  //majority voted, debounced sampling for noisy buses
+  void enableGlitchFilter(uint8_t reads = PC1550_FILTER_READS,
+                          uint16_t minPulseUs = PC1550_FILTER_MIN_PULSE_US);
+  void disableGlitchFilter();
+
+  //raw bus tracing (see PC1550Trace.h), 0 to stop
+  void attachRecorder(PC1550TraceWriter *recorder);
 
   //the following are available only when the PC16OUT is enabled
   //and the PGM terminal from the panel is connected
@@ -143,4 +618,226 @@ class PC1550 {
  
 };
 
+/* ==================================================================== */
+/*       C O M P I L E    T I M E    P I N    S P E C I A L I Z A T I O N */
+/* ==================================================================== */
+
+//Resolves an Arduino pin number to its port registers at compile time.
+//Only the ATmega328P/168 family (UNO, Nano, Pro Mini) is mapped: digital
+//pins 0-7 are PORTD, 8-13 are PORTB and 14-19 (A0-A5) are PORTC.
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || \
+    defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__)
+#define PC1550_FAST_PORTS 1
+
+template <uint8_t Pin>
+struct PC1550Port {
+  //any higher pin would map to a PORTC bit that isn't there.  Fails to
+  //compile (a negative array size) rather than read the wrong line
+  typedef char pin_must_be_0_to_19[Pin <= 19 ? 1 : -1];
+
+  static const uint8_t port = Pin < 8 ? 0 : (Pin < 14 ? 1 : 2);
+  static const uint8_t mask = 1 << (Pin < 8 ? Pin : (Pin < 14 ? Pin - 8 : Pin - 14));
+
+  static volatile uint8_t &in(){
+    return port == 0 ? PIND : (port == 1 ? PINB : PINC);
+  }
+  static volatile uint8_t &ddr(){
+    return port == 0 ? DDRD : (port == 1 ? DDRB : DDRC);
+  }
+};
+#endif
+
+//A PC1550 whose pins are fixed at compile time.  On boards with a port map
+//above, the three lines are read straight from the PINx registers (with a
+//single register read when they share a port, as the default A3/A4/A1 do)
+//and the data line is driven by flipping its DDR bit.  Other boards fall
+//back to digitalRead()/pinMode().
+//
+//    PC1550Fast<A3, A4, A1> alarm;
+//
+//Interrupt capture works as it does for PC1550, but the interrupt handler
+//itself uses the runtime pin functions.
+template <uint8_t DataPin, uint8_t ClockPin, uint8_t PgmPin>
+class PC1550Fast : public PC1550 {
+
+#ifdef PC1550_FAST_PORTS
+  typedef PC1550Port<DataPin> Data;
+  typedef PC1550Port<ClockPin> Clock;
+  typedef PC1550Port<PgmPin> Pgm;
+#endif
+
+  static void readLines(bool &clock, bool &data, bool &pgmData){
+#ifdef PC1550_FAST_PORTS
+    if (Data::port == Clock::port && Pgm::port == Clock::port){
+      uint8_t lines = Clock::in();
+      clock = lines & Clock::mask;
+      data = lines & Data::mask;
+      pgmData = lines & Pgm::mask;
+    }
+    else{
+      clock = Clock::in() & Clock::mask;
+      data = Data::in() & Data::mask;
+      pgmData = Pgm::in() & Pgm::mask;
+    }
+#else
+    clock = digitalRead(ClockPin);
+    data = digitalRead(DataPin);
+    pgmData = digitalRead(PgmPin);
+#endif
+  }
+
+  static void readVotes(uint8_t reads, uint8_t &clockHigh, uint8_t &dataHigh,
+                        uint8_t &pgmHigh){
+    bool clock, data, pgmData;
+    for (uint8_t i = 0; i < reads; i++){
+      readLines(clock, data, pgmData);
+      clockHigh += clock;
+      dataHigh += data;
+      pgmHigh += pgmData;
+    }
+  }
+
+ public:
+  PC1550Fast() : PC1550(DataPin, ClockPin, PgmPin) {}
+
+  void processClockCycle(){
+    unsigned long now = micros();
+    if (!startClockCycle(now))
+      return;
+
+    bool clock, data, pgmData;
+    readLines(clock, data, pgmData);
+    traceLines(clock, data, pgmData, now);
+
+    //when filtering glitches, vote on several reads of each line, and
+    //on a change of the clock keep sampling until it has lasted the
+    //minimum pulse
+    if (filter_reads > 0){
+      uint8_t clockHigh = clock, dataHigh = data, pgmHigh = pgmData;
+      readVotes(filter_reads - 1, clockHigh, dataHigh, pgmHigh);
+      while (filterLines(clockHigh, dataHigh, pgmHigh, now,
+                         clock, data, pgmData)){
+        delayMicroseconds((filter_min_pulse + 1) / 2);
+        now = micros();
+        clockHigh = dataHigh = pgmHigh = 0;
+        readVotes(filter_reads, clockHigh, dataHigh, pgmHigh);
+      }
+    }
+
+    checkSyncGap(clock, now);
+    uint8_t actions = readClockEdge(clock, data, pgmData, now);
+
+#ifdef PC1550_FAST_PORTS
+    //the PORT bit is held LOW, so the DDR bit alone selects between
+    //floating the line and pulling it low
+    if (actions & RELEASE_DATA) Data::ddr() &= ~Data::mask;
+    if (actions & DRIVE_DATA) Data::ddr() |= Data::mask;
+#else
+    if (actions & RELEASE_DATA) pinMode(DataPin, INPUT);
+    if (actions & DRIVE_DATA) pinMode(DataPin, OUTPUT);
+#endif
+  }
+
+  void processTransmissionCycle(){
+    do{
+      processClockCycle();
+    }
+    while (!atTransmissionEnd());
+  }
+
+  unsigned long poll(unsigned long maxMicros = 0){
+    unsigned long start = micros(), due;
+    do{
+      processClockCycle();
+    }
+    while (pollWait(start, maxMicros, due));
+    return due;
+  }
+};
+
+/* ==================================================================== */
+/*              C O M P I L E    T I M E    E V E N T S                 */
+/* ==================================================================== */
+
+//The handlers PC1550Events calls.  Derive your handlers from this and
+//declare only the ones you want; the rest are left out entirely.
+struct PC1550NoEvents {
+  static void onFrame(PC1550 &) {}                  //every frame
+  static void onStateChanged(PC1550 &) {}           //the lights changed
+  static void onKeyPress(PC1550 &, char) {}
+  static void onKeyRelease(PC1550 &, char) {}
+  static void onBeep(PC1550 &, bool) {}             //true when it starts
+};
+
+//A PC1550 (or PC1550Fast) that calls your handlers as frames come in,
+//rather than leaving the sketch to poll keypadStateChanged(),
+//keyPressed() and the rest on every pass of loop():
+//
+//    struct AlarmEvents : PC1550NoEvents {
+//      static void onKeyPress(PC1550 &alarm, char key){ Serial.println(key); }
+//    };
+//    PC1550Events<AlarmEvents> alarm;          //or, with fixed pins,
+//    PC1550Events<AlarmEvents, PC1550Fast<A3, A4, A1> > alarm;
+//
+//The handlers are bound when the sketch is compiled and called straight
+//from processClockCycle() once a frame has been published, so there is no
+//virtual call or function pointer.  Between frames the only cost is one
+//test of a flag, and events without a handler (all of them, for
+//PC1550Events<PC1550NoEvents>) cost nothing at all.  Buses polled by a
+//PC1550Scanner don't go through processClockCycle() and so raise no
+//events.
+template <class Handlers, class Base = PC1550>
+class PC1550Events : public Base {
+
+  //which handlers the sketch declared, known at compile time
+  enum {
+    FRAME     = &Handlers::onFrame != &PC1550NoEvents::onFrame,
+    CHANGED   = &Handlers::onStateChanged != &PC1550NoEvents::onStateChanged,
+    PRESSED   = &Handlers::onKeyPress != &PC1550NoEvents::onKeyPress,
+    RELEASED  = &Handlers::onKeyRelease != &PC1550NoEvents::onKeyRelease,
+    BEEP      = &Handlers::onBeep != &PC1550NoEvents::onBeep,
+    ANY       = FRAME || CHANGED || PRESSED || RELEASED || BEEP
+  };
+
+  void dispatch(){
+    if (FRAME)
+      Handlers::onFrame(*this);
+    if (CHANGED && this->bStateChanged)
+      Handlers::onStateChanged(*this);
+    if (RELEASED && this->key_released_data != 0)
+      Handlers::onKeyRelease(*this, PC1550::getKeyChar(this->key_released_data));
+    if (PRESSED && this->bKeyPressed)
+      Handlers::onKeyPress(*this, PC1550::getKeyChar(this->available_keypad_data));
+    if (BEEP && (this->controller_changed & PC1550::BEEPING))
+      Handlers::onBeep(*this, this->available_controller_data & PC1550::BEEPING);
+  }
+
+ public:
+  PC1550Events() {}
+  PC1550Events(uint8_t datapin, uint8_t clockpin, uint8_t pgmpin)
+    : Base(datapin, clockpin, pgmpin) {}
+
+  void processClockCycle(){
+    Base::processClockCycle();
+    if (ANY && this->bTransmissionEnd)
+      dispatch();
+  }
+
+  void processTransmissionCycle(){
+    do{
+      processClockCycle();
+    }
+    while (!this->bTransmissionEnd);
+  }
+
+  unsigned long poll(unsigned long maxMicros = 0){
+    unsigned long start = micros(), due;
+    do{
+      processClockCycle();
+    }
+    while (this->pollWait(start, maxMicros, due));
+    return due;
+  }
+};
+
 #endif
@@ -0,0 +1,213 @@
+#include "PC1550Beeps.h"
+
+PC1550Beeps::PC1550Beeps(){
+  reset();
+}
+
+void PC1550Beeps::reset(){
+  beeping = false;
+  last_sequence = 0;
+  seen = false;
+  tone_start = 0;
+  tone_end = 0;
+  steady = false;
+  burst_open = false;
+  burst_long = false;
+  confirmed = false;
+  burst_beeps = 0;
+  burst_start = 0;
+  train_beeps = 0;
+  train_start = 0;
+  train_last = 0;
+  train_end = 0;
+  train_period = 0;
+  event_head = 0;
+  event_tail = 0;
+  events_dropped = 0;
+}
+
+//an event that doesn't fit is dropped, as with the panel's event queue
+void PC1550Beeps::emit(uint8_t pattern, bool ongoing, uint8_t beeps,
+                       unsigned long duration, unsigned long now){
+  uint8_t next = (event_head + 1) & (PC1550_BEEP_EVENTS - 1);
+  if (next == event_tail){
+    events_dropped++;
+    return;
+  }
+  events[event_head].pattern = pattern;
+  events[event_head].ongoing = ongoing;
+  events[event_head].beeps = beeps;
+  events[event_head].durationMs = duration / 1000;
+  events[event_head].time = now;
+  event_head = next;
+}
+
+bool PC1550Beeps::read(PC1550BeepEvent &event){
+  if (event_tail == event_head)
+    return false;
+  event = events[event_tail];
+  event_tail = (event_tail + 1) & (PC1550_BEEP_EVENTS - 1);
+  return true;
+}
+
+uint16_t PC1550Beeps::eventsDropped(){
+  return events_dropped;
+}
+
+bool PC1550Beeps::update(PC1550 &panel){
+  PC1550::Snapshot snap = panel.snapshot();
+  if (snap.sequence == 0 || (seen && snap.sequence == last_sequence))
+    return false;
+  seen = true;
+  last_sequence = snap.sequence;
+  return addFrame(snap.controller & PC1550::BEEPING, snap.time);
+}
+
+//a lone short beep either starts or carries on a train of them at a
+//steady period (an exit delay), or is taken for a key
+void PC1550Beeps::singleBeep(unsigned long now){
+  unsigned long since = burst_start - train_last;
+  unsigned long stray = since > train_period ? since - train_period
+                                             : train_period - since;
+  bool inPeriod = since >= PC1550_BEEP_TRAIN_MIN_MS * 1000UL &&
+                  since <= PC1550_BEEP_TRAIN_MAX_MS * 1000UL;
+  bool onTime = stray <= PC1550_BEEP_JITTER_MS * 1000UL;
+
+  if (train_beeps >= 3){
+    if (onTime){
+      if (train_beeps < 255)
+        train_beeps++;
+      train_last = burst_start;
+      train_end = tone_end;
+      return;
+    }
+    emit(EXIT_DELAY, false, train_beeps, train_end - train_start, now);
+    train_beeps = 0;
+  }
+
+  if (train_beeps == 2 && inPeriod && onTime){
+    train_beeps = 3;
+    train_last = burst_start;
+    train_end = tone_end;
+    emit(EXIT_DELAY, true, 3, tone_end - train_start, now);
+    return;
+  }
+
+  //a second beep sets the period; one off it starts again from the last
+  if (train_beeps > 0 && inPeriod){
+    train_start = train_beeps == 1 ? train_start : train_last;
+    train_beeps = 2;
+    train_period = since;
+  }
+  else{
+    train_beeps = 1;
+    train_start = burst_start;
+  }
+  train_last = burst_start;
+  train_end = tone_end;
+  emit(ACK, false, 1, tone_end - burst_start, now);
+}
+
+//names a burst of beeps once the silence after it is long enough
+void PC1550Beeps::closeBurst(unsigned long now){
+  burst_open = false;
+  unsigned long duration = tone_end - burst_start;
+  if (confirmed)
+    emit(CONFIRM, false, burst_beeps, duration, now);
+  else if (burst_long)
+    emit(OTHER, false, burst_beeps, duration, now);
+  else if (burst_beeps >= 3)
+    emit(CONFIRM, false, burst_beeps, duration, now);
+  else if (burst_beeps == 2)
+    emit(TROUBLE, false, 2, duration, now);
+  else
+    singleBeep(now);
+}
+
+//a long tone is a pattern of its own, so the burst it sounded in is
+//named without it
+void PC1550Beeps::closeBeforeTone(unsigned long now){
+  if (!burst_open)
+    return;
+  burst_beeps--;
+  if (burst_beeps > 0)
+    closeBurst(now);
+  burst_open = false;
+}
+
+bool PC1550Beeps::addFrame(bool beeping, unsigned long now){
+  uint8_t before = event_head;
+
+  if (!this->beeping){
+    if (burst_open && now - tone_end >= PC1550_BEEP_GAP_MS * 1000UL)
+      closeBurst(now);
+
+    //a train ends when a beep is overdue (one that has started is judged
+    //once its burst is over); shorter ones are just forgotten
+    unsigned long since = now - train_last;
+    if (!burst_open && train_beeps >= 3 &&
+        since > train_period + PC1550_BEEP_JITTER_MS * 1000UL){
+      emit(EXIT_DELAY, false, train_beeps, train_end - train_start, now);
+      train_beeps = 0;
+    }
+    else if (!burst_open && train_beeps < 3 &&
+             since > PC1550_BEEP_TRAIN_MAX_MS * 1000UL)
+      train_beeps = 0;
+
+    if (beeping){
+      tone_start = now;
+      steady = false;
+      if (!burst_open){
+        burst_open = true;
+        burst_long = false;
+        confirmed = false;
+        burst_beeps = 0;
+        burst_start = now;
+      }
+      if (burst_beeps < 255)
+        burst_beeps++;
+    }
+  }
+  else if (beeping){
+    if (now - tone_start >= PC1550_BEEP_ERROR_MS * 1000UL)
+      closeBeforeTone(now);
+    if (!steady && now - tone_start >= PC1550_BEEP_STEADY_MS * 1000UL){
+      steady = true;
+      emit(ENTRY_DELAY, true, 1, now - tone_start, now);
+    }
+  }
+  else{
+    //a long tone is a pattern of its own, after the beeps just before it
+    //(those are normally named while it sounds)
+    unsigned long length = now - tone_start;
+    if (steady || length >= PC1550_BEEP_ERROR_MS * 1000UL){
+      closeBeforeTone(now);
+      emit(steady ? ENTRY_DELAY : ERROR, false, 1, length, now);
+    }
+    else if (length > PC1550_BEEP_SHORT_MS * 1000UL)
+      burst_long = true;
+
+    //three short beeps close together can only be a confirmation
+    else if (burst_beeps == 3 && !burst_long){
+      confirmed = true;
+      emit(CONFIRM, true, 3, now - burst_start, now);
+    }
+    tone_end = now;
+  }
+
+  this->beeping = beeping;
+  return event_head != before;
+}
+
+const char *PC1550Beeps::patternName(uint8_t pattern){
+  switch(pattern)
+    {
+    case ACK: return "ack";
+    case ERROR: return "error";
+    case CONFIRM: return "confirm";
+    case TROUBLE: return "trouble";
+    case EXIT_DELAY: return "exit delay";
+    case ENTRY_DELAY: return "entry delay";
+    default: return "other";
+    }
+}
@@ -0,0 +1,165 @@
+#ifndef DSC_PC1550_BEEPS_H
+#define DSC_PC1550_BEEPS_H
+
+/*
+ * Tells the panel's beeps apart as they happen.
+ *
+ * The panel only says whether the keypad is beeping in each frame.  This
+ * follows that bit from frame to frame and names the pattern it makes:
+ *
+ *   ACK          a single short beep, as for a key
+ *   ERROR        one tone of a second or more (the panel's two second
+ *                error tone)
+ *   CONFIRM      three or more short beeps close together
+ *   TROUBLE      two short beeps close together
+ *   EXIT_DELAY   short beeps repeating at a steady 0.5 to 1.5s
+ *   ENTRY_DELAY  one steady tone longer than PC1550_BEEP_STEADY_MS
+ *   OTHER        anything else, such as short beeps mixed with longer ones
+ *
+ * A pattern is reported in the first frame it can be told apart: a tone
+ * when it stops, a burst of short beeps PC1550_BEEP_GAP_MS after its last
+ * (or once a tone straight after it has lasted PC1550_BEEP_ERROR_MS).
+ * Patterns that go on for a while (CONFIRM, EXIT_DELAY, ENTRY_DELAY) are
+ * also reported, with ongoing set, as soon as they are recognised.  Every
+ * pattern ends with exactly one event with ongoing clear, carrying its
+ * full duration and number of beeps.  The first two beeps of an exit delay
+ * are reported as ACKs, since they could still be keys.
+ *
+ *     PC1550Beeps beeps;
+ *     PC1550BeepEvent event;
+ *     ...
+ *     alarm.processClockCycle();
+ *     beeps.update(alarm);
+ *     while (beeps.read(event))
+ *       if (event.pattern == PC1550Beeps::ENTRY_DELAY && event.ongoing) ...
+ *
+ * It keeps a few bytes of state whatever it has heard, and update() has
+ * to see every frame (frames it misses are taken as unchanged).
+ */
+
+#include "PC1550.h"
+
+//the longest tone still counted as a short beep
+#ifndef PC1550_BEEP_SHORT_MS
+#define PC1550_BEEP_SHORT_MS 300
+#endif
+
+//silence that ends a burst of short beeps
+#ifndef PC1550_BEEP_GAP_MS
+#define PC1550_BEEP_GAP_MS 250
+#endif
+
+//the shortest error tone, and the shortest steady entry delay tone
+#ifndef PC1550_BEEP_ERROR_MS
+#define PC1550_BEEP_ERROR_MS 1000
+#endif
+#ifndef PC1550_BEEP_STEADY_MS
+#define PC1550_BEEP_STEADY_MS 3000
+#endif
+
+//the range of periods of exit delay beeps, and how far one may stray from
+//the last
+#ifndef PC1550_BEEP_TRAIN_MIN_MS
+#define PC1550_BEEP_TRAIN_MIN_MS 500
+#endif
+#ifndef PC1550_BEEP_TRAIN_MAX_MS
+#define PC1550_BEEP_TRAIN_MAX_MS 1500
+#endif
+#ifndef PC1550_BEEP_JITTER_MS
+#define PC1550_BEEP_JITTER_MS 150
+#endif
+
+//number of events held for read() before new ones are dropped (must be a
+//power of two; one slot is always kept free)
+#ifndef PC1550_BEEP_EVENTS
+#define PC1550_BEEP_EVENTS 4
+#endif
+
+struct PC1550BeepEvent {
+  uint8_t pattern;           //PC1550Beeps::ACK ... OTHER
+  bool ongoing;              //true while the pattern is still sounding
+  uint8_t beeps;             //beeps so far (255 at most)
+  unsigned long durationMs;  //from the start of its first beep to the end
+                             //of its last (or to now, if ongoing)
+  unsigned long time;        //micros() of the frame it was told apart in
+};
+
+class PC1550Beeps {
+
+  //the beep bit in the last frame, and the frame's sequence number
+  bool beeping;
+  uint32_t last_sequence;
+  bool seen;
+
+  //the tone sounding (or the last one), and whether it has been reported
+  //as an entry delay
+  unsigned long tone_start;
+  unsigned long tone_end;
+  bool steady;
+
+  //the burst of beeps close together being heard, whether it had a tone
+  //too long to be a short beep, and whether it has been reported as a
+  //confirmation
+  bool burst_open;
+  bool burst_long;
+  bool confirmed;
+  uint8_t burst_beeps;
+  unsigned long burst_start;
+
+  //single short beeps at a steady period: how many, when the first and
+  //last started, when the last ended, and the period between the first
+  //two
+  uint8_t train_beeps;
+  unsigned long train_start;
+  unsigned long train_last;
+  unsigned long train_end;
+  unsigned long train_period;
+
+  //classified patterns waiting for read(), and those lost because it
+  //wasn't called in time
+  PC1550BeepEvent events[PC1550_BEEP_EVENTS];
+  uint8_t event_head;
+  uint8_t event_tail;
+  uint16_t events_dropped;
+
+  void emit(uint8_t pattern, bool ongoing, uint8_t beeps,
+            unsigned long duration, unsigned long now);
+  void closeBurst(unsigned long now);
+  void closeBeforeTone(unsigned long now);
+  void singleBeep(unsigned long now);
+
+ public:
+  //patterns
+  enum {
+    ACK,
+    ERROR,
+    CONFIRM,
+    TROUBLE,
+    EXIT_DELAY,
+    ENTRY_DELAY,
+    OTHER
+  };
+
+  PC1550Beeps();
+
+  //looks at the panel's latest frame, if it hasn't already.  Returns true
+  //if that made any events
+  bool update(PC1550 &panel);
+
+  //the same, for a frame from somewhere else (a trace, say) with its
+  //micros() time.  Frames must come in order
+  bool addFrame(bool beeping, unsigned long time);
+
+  //takes the oldest event.  Returns false if there are none
+  bool read(PC1550BeepEvent &event);
+
+  //the number of events lost because they were not read in time
+  uint16_t eventsDropped();
+
+  //forgets everything heard, and any events not yet read
+  void reset();
+
+  static const char *patternName(uint8_t pattern);
+};
+
+#endif
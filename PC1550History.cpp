@@ -0,0 +1,274 @@
+#include "PC1550History.h"
+
+PC1550History::PC1550History(){
+  reset();
+}
+
+void PC1550History::reset(){
+  head = 0;
+  tail = 0;
+  used = 0;
+  records = 0;
+  base_controller = 0;
+  base_pc16out = 0;
+  controller = 0;
+  pc16out = 0;
+  run = 0;
+  started = false;
+  span = 0;
+  last_sequence = 0;
+  last_time = 0;
+  elapsed_us = 0;
+  timed_frames = 0;
+}
+
+uint8_t PC1550History::byteAt(uint16_t offset){
+  return arena[offset % PC1550_HISTORY_BYTES];
+}
+
+void PC1550History::push(uint8_t value){
+  arena[head] = value;
+  head = (head + 1) % PC1550_HISTORY_BYTES;
+  used++;
+}
+
+//decodes the record starting at an offset.  Returns its length
+uint16_t PC1550History::readRecord(uint16_t at, uint32_t &count,
+                                   uint16_t &controllerDelta,
+                                   uint16_t &pc16outDelta){
+  uint8_t flags = byteAt(at);
+  uint16_t length = 1;
+
+  count = flags >> 4;
+  if (count == 0){
+    uint8_t shift = 0;
+    uint8_t value;
+    do{
+      value = byteAt(at + length++);
+      count |= (uint32_t)(value & 0x7F) << shift;
+      shift += 7;
+    } while (value & 0x80);
+  }
+
+  controllerDelta = 0;
+  pc16outDelta = 0;
+  if (flags & 0x01) controllerDelta |= (uint16_t)byteAt(at + length++) << 8;
+  if (flags & 0x02) controllerDelta |= byteAt(at + length++);
+  if (flags & 0x04) pc16outDelta |= (uint16_t)byteAt(at + length++) << 8;
+  if (flags & 0x08) pc16outDelta |= byteAt(at + length++);
+  return length;
+}
+
+//the state after the oldest record becomes the one the history starts from
+void PC1550History::dropOldest(){
+  uint32_t count;
+  uint16_t controllerDelta, pc16outDelta;
+  uint16_t length = readRecord(tail, count, controllerDelta, pc16outDelta);
+  base_controller ^= controllerDelta;
+  base_pc16out ^= pc16outDelta;
+  span -= count;
+  tail = (tail + length) % PC1550_HISTORY_BYTES;
+  used -= length;
+  records--;
+}
+
+void PC1550History::addRecord(uint32_t count, uint16_t controllerDelta,
+                              uint16_t pc16outDelta){
+  uint8_t flags = 0;
+  if (controllerDelta & 0xFF00) flags |= 0x01;
+  if (controllerDelta & 0x00FF) flags |= 0x02;
+  if (pc16outDelta & 0xFF00) flags |= 0x04;
+  if (pc16outDelta & 0x00FF) flags |= 0x08;
+
+  uint16_t length = 1;
+  if (count > 15)
+    for (uint32_t c = count; c != 0; c >>= 7)
+      length++;
+  else
+    flags |= count << 4;
+  for (uint8_t f = flags & 0x0F; f != 0; f >>= 1)
+    length += f & 1;
+
+  while (PC1550_HISTORY_BYTES - used < length)
+    dropOldest();
+
+  push(flags);
+  if (count > 15)
+    for (uint32_t c = count; c != 0; c >>= 7)
+      push((c & 0x7F) | (c > 0x7F ? 0x80 : 0));
+  if (flags & 0x01) push(controllerDelta >> 8);
+  if (flags & 0x02) push(controllerDelta);
+  if (flags & 0x04) push(pc16outDelta >> 8);
+  if (flags & 0x08) push(pc16outDelta);
+  records++;
+}
+
+bool PC1550History::update(PC1550 &panel){
+  PC1550::Snapshot snap = panel.snapshot();
+  if (snap.sequence == 0 || snap.sequence == last_sequence)
+    return false;
+  uint32_t frames = last_sequence == 0 ? 1 : snap.sequence - last_sequence;
+  last_sequence = snap.sequence;
+  return addFrame(snap.controller, snap.pc16out, snap.time, frames);
+}
+
+bool PC1550History::addFrame(uint16_t controller, uint16_t pc16out,
+                             unsigned long time, uint32_t frames){
+  if (!started){
+    started = true;
+    base_controller = this->controller = controller;
+    base_pc16out = this->pc16out = pc16out;
+    run = 1;
+    span = 1;
+    last_time = time;
+    return true;
+  }
+
+  //halving both totals (the time in proportion to the whole frames left)
+  //keeps the average they give, and the older half of it has less say
+  //from then on
+  uint32_t elapsed = time - last_time;
+  if (elapsed > 0x7FFFFFFFUL)
+    elapsed = 0x7FFFFFFFUL;
+  while (elapsed_us > 0x7FFFFFFFUL - elapsed){
+    uint32_t half = timed_frames / 2;
+    if (half == 0){
+      elapsed_us = 0;
+      timed_frames = 0;
+      break;
+    }
+    elapsed_us = elapsed_us / timed_frames * half +
+      elapsed_us % timed_frames * half / timed_frames;
+    timed_frames = half;
+  }
+  elapsed_us += elapsed;
+  timed_frames += frames;
+  last_time = time;
+
+  //frames missed in between are repeats of the last one seen
+  run += frames - 1;
+  span += frames;
+  if (controller == this->controller && pc16out == this->pc16out){
+    run++;
+    return false;
+  }
+
+  addRecord(run, controller ^ this->controller, pc16out ^ this->pc16out);
+  this->controller = controller;
+  this->pc16out = pc16out;
+  run = 1;
+  return true;
+}
+
+void PC1550History::fill(PC1550HistoryEntry &entry, uint16_t controller,
+                         uint16_t pc16out, uint32_t framesAgo,
+                         uint32_t frames){
+  entry.controller = controller;
+  entry.pc16out = pc16out;
+  entry.framesAgo = framesAgo;
+  entry.frames = frames;
+  entry.msAgo = framesToMs(framesAgo);
+}
+
+//walks the records from the oldest, where the history starts span - 1
+//frames before the latest
+bool PC1550History::stateFramesAgo(uint32_t frames, PC1550HistoryEntry &entry){
+  if (!started || frames >= span)
+    return false;
+  if (frames < run){
+    fill(entry, controller, pc16out, run - 1, run);
+    return true;
+  }
+
+  uint16_t state_controller = base_controller;
+  uint16_t state_pc16out = base_pc16out;
+  uint32_t began = span - 1;
+  uint16_t at = tail;
+  for (uint16_t i = 0; i < records; i++){
+    uint32_t count;
+    uint16_t controllerDelta, pc16outDelta;
+    at += readRecord(at, count, controllerDelta, pc16outDelta);
+    if (frames > began - count){
+      fill(entry, state_controller, state_pc16out, began, count);
+      return true;
+    }
+    began -= count;
+    state_controller ^= controllerDelta;
+    state_pc16out ^= pc16outDelta;
+  }
+  return false;
+}
+
+bool PC1550History::stateMsAgo(unsigned long ms, PC1550HistoryEntry &entry){
+  return stateFramesAgo(msToFrames(ms), entry);
+}
+
+//the newest states come last in the arena, so the ones wanted are found
+//on the way through and stored from the end of entries back
+uint8_t PC1550History::lastTransitions(PC1550HistoryEntry *entries,
+                                       uint8_t count){
+  if (!started || count == 0)
+    return 0;
+  uint16_t states = records + 1;
+  uint16_t skip = states > count ? states - count : 0;
+
+  uint16_t state_controller = base_controller;
+  uint16_t state_pc16out = base_pc16out;
+  uint32_t began = span - 1;
+  uint16_t at = tail;
+  for (uint16_t i = 0; i < records; i++){
+    uint32_t frames;
+    uint16_t controllerDelta, pc16outDelta;
+    at += readRecord(at, frames, controllerDelta, pc16outDelta);
+    if (i >= skip)
+      fill(entries[records - i], state_controller, state_pc16out, began, frames);
+    began -= frames;
+    state_controller ^= controllerDelta;
+    state_pc16out ^= pc16outDelta;
+  }
+  fill(entries[0], controller, pc16out, run - 1, run);
+  return states - skip;
+}
+
+uint16_t PC1550History::transitions(){
+  return records;
+}
+
+uint32_t PC1550History::spanFrames(){
+  return span;
+}
+
+unsigned long PC1550History::spanMs(){
+  return framesToMs(span);
+}
+
+uint16_t PC1550History::bytesUsed(){
+  return used;
+}
+
+//64 bit arithmetic keeps hours of ms times frames from overflowing
+//the average frame period in 1/16us, or 0 before there are two frames
+uint32_t PC1550History::framePeriod(){
+  if (timed_frames == 0)
+    return 0;
+  return elapsed_us / timed_frames * 16 +
+    elapsed_us % timed_frames * 16 / timed_frames;
+}
+
+//both are worked in parts, so no product needs more than 32 bits until
+//the answer itself does
+unsigned long PC1550History::framesToMs(uint32_t frames){
+  uint32_t period = framePeriod();
+  uint32_t thousands = frames / 1000;
+  return (unsigned long)thousands * (period / 16) +
+    thousands * (period % 16) / 16 + (frames % 1000) * period / 16000;
+}
+
+uint32_t PC1550History::msToFrames(unsigned long ms){
+  uint32_t period = framePeriod();
+  if (period == 0)
+    return 0;
+  uint32_t rest = ms % period * 16;
+  return (uint32_t)(ms / period * 16000 + rest / period * 1000 +
+                    rest % period * 1000 / period);
+}
@@ -0,0 +1,127 @@
+#ifndef DSC_PC1550_HISTORY_H
+#define DSC_PC1550_HISTORY_H
+
+/*
+ * A history of the panel's lights and PC16-OUT bits in a few hundred bytes.
+ *
+ * The panel sends the same frame over and over, so only the changes are
+ * kept: each state the panel was in is a record of how many frames it
+ * lasted and which bits then changed.  Records are packed into a fixed
+ * arena of PC1550_HISTORY_BYTES, oldest dropped first to make room, and
+ * take two to six bytes (a flag byte, the frame count, and the bytes of
+ * the two words that changed), so the default 256 bytes hold the last 50
+ * to 120 changes however long ago they were.
+ *
+ *     PC1550History history;
+ *     ...
+ *     alarm.processClockCycle();
+ *     history.update(alarm);
+ *     ...
+ *     PC1550HistoryEntry entry;
+ *     if (history.stateMsAgo(60000UL, entry) && entry.controller & ...)
+ *
+ * The history counts frames, so a state "frames ago" is exact.  Times in
+ * ms are converted at the average frame period over the last half hour or so
+ * (its totals are halved before they can overflow, so it runs for good)
+ * and are as close as that is steady.  update() has to see every frame (a
+ * frame it misses is taken as a repeat of the one before).
+ */
+
+#include "PC1550.h"
+
+//size of the record arena
+#ifndef PC1550_HISTORY_BYTES
+#define PC1550_HISTORY_BYTES 256
+#endif
+
+struct PC1550HistoryEntry {
+  uint16_t controller;     //light bits, PC1550::ZONE1_LIGHT ... BEEPING
+  uint16_t pc16out;        //PC16-OUT bits
+  uint32_t framesAgo;      //frames between its first frame and the latest
+                           //(0 if it began with the latest)
+  uint32_t frames;         //frames it lasted (so far, for the latest)
+  unsigned long msAgo;     //framesAgo in ms
+};
+
+class PC1550History {
+
+  //the records, oldest at tail.  Each is a flag byte (bits 0-3 say which
+  //of the controller high, controller low, PC16-OUT high and PC16-OUT low
+  //bytes changed, bits 4-7 are the frame count if it is 1-15), the frame
+  //count as 7 bit groups if it isn't, and the XOR of each changed byte
+  uint8_t arena[PC1550_HISTORY_BYTES];
+  uint16_t head;
+  uint16_t tail;
+  uint16_t used;
+  uint16_t records;
+
+  //the state the oldest record starts from, and the latest state and how
+  //many frames it has lasted so far
+  uint16_t base_controller;
+  uint16_t base_pc16out;
+  uint16_t controller;
+  uint16_t pc16out;
+  uint32_t run;
+  bool started;
+
+  //frames covered by the records and the latest state
+  uint32_t span;
+
+  //the last frame update() saw
+  uint32_t last_sequence;
+
+  //the latest frame's time, and the time and frames since the first
+  //(both halved whenever the time would pass 31 bits), for converting to
+  //and from ms
+  unsigned long last_time;
+  uint32_t elapsed_us;
+  uint32_t timed_frames;
+
+  uint8_t byteAt(uint16_t offset);
+  void push(uint8_t value);
+  uint16_t readRecord(uint16_t at, uint32_t &count, uint16_t &controllerDelta,
+                      uint16_t &pc16outDelta);
+  void dropOldest();
+  void addRecord(uint32_t count, uint16_t controllerDelta, uint16_t pc16outDelta);
+  uint32_t framePeriod();
+  void fill(PC1550HistoryEntry &entry, uint16_t controller, uint16_t pc16out,
+            uint32_t framesAgo, uint32_t frames);
+
+ public:
+  PC1550History();
+
+  //adds the panel's latest frame, if it hasn't already.  Returns true if
+  //the state changed
+  bool update(PC1550 &panel);
+
+  //the same, for a frame from somewhere else (a trace, say) with its
+  //micros() time.  frames is how many frames on from the last one it is
+  bool addFrame(uint16_t controller, uint16_t pc16out, unsigned long time,
+                uint32_t frames = 1);
+
+  //the state the panel was in a number of frames (or ms) before the
+  //latest frame.  Returns false if that is older than the history
+  bool stateFramesAgo(uint32_t frames, PC1550HistoryEntry &entry);
+  bool stateMsAgo(unsigned long ms, PC1550HistoryEntry &entry);
+
+  //fills entries with the latest state and the ones before it, newest
+  //first, each with when the change into it came.  Returns how many it
+  //filled
+  uint8_t lastTransitions(PC1550HistoryEntry *entries, uint8_t count);
+
+  //the changes held, how far back they go, and the arena bytes they use
+  uint16_t transitions();
+  uint32_t spanFrames();
+  unsigned long spanMs();
+  uint16_t bytesUsed();
+
+  //ms in a number of frames, and frames in a number of ms, at the average
+  //frame period
+  unsigned long framesToMs(uint32_t frames);
+  uint32_t msToFrames(unsigned long ms);
+
+  //forgets everything
+  void reset();
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Forwards the Arduino functions declared in PC1550Host.h to the installed
+ * PC1550Backend.  Compiled only outside the Arduino environment.
+ */
+#ifndef ARDUINO
+
+#include "PC1550Host.h"
+
+static PC1550Backend *backend = 0;
+static void (*handlers[PC1550_HOST_PINS])(void);
+
+static void (*timer_handler)(void) = 0;
+static unsigned long timer_period = 0;
+static unsigned long timer_next = 0;
+static bool in_timer = false;
+
+void PC1550SetBackend(PC1550Backend *b){
+  backend = b;
+}
+
+PC1550Backend *PC1550GetBackend(){
+  return backend;
+}
+
+void PC1550Backend::raiseInterrupt(uint8_t pin){
+  if (pin < PC1550_HOST_PINS && handlers[pin] != 0)
+    handlers[pin]();
+}
+
+int digitalRead(uint8_t pin){
+  return backend->digitalRead(pin);
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+  backend->pinMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+  backend->digitalWrite(pin, value);
+}
+
+unsigned long micros(){
+  return backend->micros();
+}
+
+unsigned long millis(){
+  return backend->micros() / 1000;
+}
+
+void delayMicroseconds(unsigned int us){
+  backend->delayMicroseconds(us);
+}
+
+void PC1550Sleep(){
+  backend->sleepUntilInterrupt();
+}
+
+//interrupt numbers are pin numbers on the host
+int digitalPinToInterrupt(uint8_t pin){
+  return pin < PC1550_HOST_PINS ? pin : NOT_AN_INTERRUPT;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int){
+  if (interrupt < PC1550_HOST_PINS)
+    handlers[interrupt] = handler;
+}
+
+void detachInterrupt(uint8_t interrupt){
+  if (interrupt < PC1550_HOST_PINS)
+    handlers[interrupt] = 0;
+}
+
+void PC1550StartTimer(unsigned long periodUs, void (*handler)(void)){
+  timer_period = periodUs;
+  timer_next = backend->micros() + periodUs;
+  timer_handler = handler;
+}
+
+void PC1550StopTimer(){
+  timer_handler = 0;
+}
+
+bool PC1550Backend::timerDue(unsigned long time){
+  return timer_handler != 0 && !in_timer && (long)(time - timer_next) >= 0;
+}
+
+unsigned long PC1550Backend::nextTimerTick(){
+  return timer_next;
+}
+
+//a tick that comes due while the handler runs is taken once it returns,
+//as a pending timer interrupt would be
+void PC1550Backend::runTimer(){
+  timer_next += timer_period;
+  in_timer = true;
+  timer_handler();
+  in_timer = false;
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef DSC_PC1550_HOST_H
+#define DSC_PC1550_HOST_H
+
+/*
+ * Off-target (host) support for the PC1550 library.
+ *
+ * When the library is compiled outside the Arduino environment this header
+ * stands in for Arduino.h.  It declares the handful of Arduino functions the
+ * library uses and forwards each of them to a pluggable PC1550Backend, so
+ * the decoder in PC1550.cpp runs unchanged against a simulator (see
+ * extras/host) or any other source of pin levels and time.
+ *
+ * Every pin can raise an interrupt on the host: attachInterrupt() records
+ * the handler and the backend calls PC1550Backend::raiseInterrupt() when a
+ * line it owns changes.  Likewise PC1550StartTimer() stands in for a
+ * hardware timer, and backends with simulated time run its handler with
+ * PC1550Backend::runTimer() as their clock passes each tick.
+ */
+
+#include <stdint.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define CHANGE 1
+#define NOT_AN_INTERRUPT -1
+
+//pin numbers of the UNO's analog pins, which are the library defaults
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+
+//the number of pins a backend can be asked about
+#define PC1550_HOST_PINS 32
+
+class PC1550Backend {
+ public:
+  virtual ~PC1550Backend() {}
+
+  //the level currently on a pin
+  virtual int digitalRead(uint8_t pin) = 0;
+
+  //INPUT lets a pin float, OUTPUT drives it to its digitalWrite() level
+  virtual void pinMode(uint8_t pin, uint8_t mode) = 0;
+  virtual void digitalWrite(uint8_t pin, uint8_t value) = 0;
+
+  //time since the backend started, in microseconds
+  virtual unsigned long micros() = 0;
+
+  //a simulated backend advances its clock instead of waiting
+  virtual void delayMicroseconds(unsigned int us) = 0;
+
+  //waits for the next interrupt the backend raises, as a sleeping
+  //processor would.  A backend that can't tell when that will be returns
+  //at once, and the caller simply polls again
+  virtual void sleepUntilInterrupt() {}
+
+  //calls the handler attached to pin, if any
+  static void raiseInterrupt(uint8_t pin);
+
+  //true if the timer has a tick due at or before time, and isn't already
+  //in its handler.  runTimer() calls the handler for the next tick
+  static bool timerDue(unsigned long time);
+  static unsigned long nextTimerTick();
+  static void runTimer();
+};
+
+//installs the backend used by all of the functions below
+void PC1550SetBackend(PC1550Backend *backend);
+PC1550Backend *PC1550GetBackend();
+
+int digitalRead(uint8_t pin);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+unsigned long micros();
+unsigned long millis();
+void delayMicroseconds(unsigned int us);
+
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+//a periodic timer interrupt, every periodUs from now
+void PC1550StartTimer(unsigned long periodUs, void (*handler)(void));
+void PC1550StopTimer();
+
+//stands in for the processor's sleep instruction
+void PC1550Sleep();
+
+//host backends call interrupt handlers from the thread that runs the
+//decoder, so there is nothing to mask
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+#endif
@@ -0,0 +1,149 @@
+#include "PC1550Macro.h"
+
+PC1550Macro::PC1550Macro(PC1550 &panel){
+  this->panel = &panel;
+  steps = 0;
+  state = IDLE;
+  current = 0;
+  resend = 0;
+  sequence = 0;
+  attempts = 0;
+  total_retries = 0;
+  wait_start = 0;
+  beeps = 0;
+  started = 0;
+  finished = 0;
+}
+
+bool PC1550Macro::start(const PC1550MacroStep *steps){
+  if (state == RUNNING)
+    return false;
+  this->steps = steps;
+  state = RUNNING;
+  total_retries = 0;
+  started = micros();
+  enterStep(0, started);
+  return true;
+}
+
+//the sendKeys() queue has no way to drop a single sequence, so keys of
+//the macro still waiting to go out take the rest of the queue with them
+void PC1550Macro::stop(){
+  if (state != RUNNING)
+    return;
+  if (sequence != 0)
+    panel->clearKeys();
+  state = IDLE;
+  finished = micros();
+}
+
+void PC1550Macro::enterStep(uint8_t step, unsigned long now){
+  current = step;
+  wait_start = now;
+  beeps = 0;
+  if (steps[step].type == SEND){
+    resend = step;
+    sequence = 0;
+    attempts = 0;
+  }
+}
+
+//goes back to the last SEND, if the step's retries allow.  Otherwise the
+//macro has failed
+bool PC1550Macro::retry(uint8_t allowed, unsigned long now){
+  if (attempts >= allowed){
+    state = FAILED;
+    finished = now;
+    return false;
+  }
+  attempts++;
+  total_retries++;
+  current = resend;
+  sequence = 0;
+  return true;
+}
+
+//checks a wait against the latest frame.  Called once per frame
+bool PC1550Macro::waitMet(const PC1550MacroStep &step){
+  PC1550::Snapshot snap = panel->snapshot();
+  switch(step.type)
+    {
+    case WAIT_LIGHTS:
+      return (snap.controller & step.mask) == step.value;
+    case WAIT_PC16OUT:
+      return (snap.pc16out & step.mask) == step.value;
+    case WAIT_BEEPS:
+      if ((snap.controllerChanged & snap.controller) & PC1550::BEEPING)
+        beeps++;
+      return beeps >= step.value;
+    }
+  return false;
+}
+
+uint8_t PC1550Macro::update(){
+  if (state != RUNNING)
+    return state;
+  unsigned long now = micros();
+  bool frame = panel->atTransmissionEnd();
+
+  //a step that completes goes straight on to the next, so the keys of a
+  //SEND after a wait are queued in the same frame the wait ended
+  while (state == RUNNING){
+    const PC1550MacroStep &step = steps[current];
+
+    if (step.type == END){
+      state = DONE;
+      finished = now;
+    }
+    else if (step.type == SEND){
+      if (sequence == 0){
+        sequence = panel->sendKeys(step.keys);
+
+        //a full queue (of the sketch's keys) is waited out; anything
+        //else means the keys themselves were refused
+        if (sequence == 0 && panel->keysQueued() == 0){
+          state = FAILED;
+          finished = now;
+        }
+        break;
+      }
+      if (!frame || panel->keysDone() != sequence)
+        break;
+
+      //the wait after the keys starts with the next frame, since this
+      //one was read before the panel acted on the last key
+      if (panel->keysDoneSent()){
+        sequence = 0;
+        enterStep(current + 1, now);
+        frame = false;
+      }
+      else
+        retry(step.retries, now);
+    }
+    else if (frame && waitMet(step))
+      enterStep(current + 1, now);
+    else if (step.timeoutMs != 0 && now - wait_start >= step.timeoutMs * 1000UL)
+      retry(step.retries, now);
+    else
+      break;
+  }
+  return state;
+}
+
+uint8_t PC1550Macro::status(){
+  return state;
+}
+
+uint8_t PC1550Macro::step(){
+  return current;
+}
+
+uint16_t PC1550Macro::retries(){
+  return total_retries;
+}
+
+unsigned long PC1550Macro::elapsedMs(){
+  if (steps == 0)
+    return 0;
+  return ((state == RUNNING ? micros() : finished) - started) / 1000;
+}
@@ -0,0 +1,128 @@
+#ifndef DSC_PC1550_MACRO_H
+#define DSC_PC1550_MACRO_H
+
+/*
+ * Keypad macros that wait on what the panel does rather than on the clock.
+ *
+ * A macro is a list of steps: send some keys, then wait until the lights
+ * (or the PC16-OUT bits, or the beeper) show the panel did what was asked,
+ * with a timeout.  Each step is checked against every frame, so the macro
+ * moves on in the very frame the panel shows the change, and the keys of
+ * the next step go out in the first cycle the panel will take them.
+ *
+ *     const PC1550MacroStep armStay[] = {
+ *       PC1550_MACRO_SEND("1234", 2),
+ *       PC1550_MACRO_WAIT_LIGHTS(PC1550::ARMED_LIGHT, PC1550::ARMED_LIGHT,
+ *                                3000, 2),
+ *       PC1550_MACRO_END
+ *     };
+ *
+ *     PC1550Macro macro(alarm);
+ *     macro.start(armStay);
+ *     ...
+ *     alarm.processClockCycle();
+ *     if (macro.update() == PC1550Macro::FAILED) ...
+ *
+ * The retries of a step are how many times the keys before it may be sent
+ * again: a SEND step is repeated when a key isn't read back from the bus
+ * intact, and a WAIT step that times out goes back to the last SEND.  Both
+ * draw on one count, which starts over at every SEND the macro reaches
+ * normally.  A wait only starts once the keys before it have all been
+ * confirmed, so a light that was already on can't end it early; a timeout
+ * of 0 waits for ever.
+ *
+ * update() has to see every frame (call it after every processClockCycle()
+ * or poll(), or from onFrame()), and a macro shares the sendKeys() queue
+ * with the sketch.
+ */
+
+#include "PC1550.h"
+
+struct PC1550MacroStep {
+  uint8_t type;         //PC1550Macro::SEND ... END
+  const char *keys;     //SEND: the keys, as for sendKeys()
+  uint16_t mask;        //WAIT_LIGHTS, WAIT_PC16OUT: the bits to look at
+  uint16_t value;       //...and the value they must have, or WAIT_BEEPS:
+                        //the number of beeps
+  uint16_t timeoutMs;   //waits: how long before giving up, 0 for ever
+  uint8_t retries;
+};
+
+#define PC1550_MACRO_SEND(keys, retries) \
+  { PC1550Macro::SEND, keys, 0, 0, 0, retries }
+#define PC1550_MACRO_WAIT_LIGHTS(mask, value, timeoutMs, retries) \
+  { PC1550Macro::WAIT_LIGHTS, 0, mask, value, timeoutMs, retries }
+#define PC1550_MACRO_WAIT_PC16OUT(mask, value, timeoutMs, retries) \
+  { PC1550Macro::WAIT_PC16OUT, 0, mask, value, timeoutMs, retries }
+#define PC1550_MACRO_WAIT_BEEPS(count, timeoutMs, retries) \
+  { PC1550Macro::WAIT_BEEPS, 0, 0, count, timeoutMs, retries }
+#define PC1550_MACRO_END \
+  { PC1550Macro::END, 0, 0, 0, 0, 0 }
+
+class PC1550Macro {
+
+  PC1550 *panel;
+  const PC1550MacroStep *steps;
+  uint8_t state;
+
+  //the step being run, and the SEND step a timed out wait goes back to
+  uint8_t current;
+  uint8_t resend;
+
+  //the keys of the current SEND in flight (0 before they are queued),
+  //and the number of times keys have been sent again
+  uint8_t sequence;
+  uint8_t attempts;
+  uint16_t total_retries;
+
+  //when the current wait started, and the beeps seen since
+  unsigned long wait_start;
+  uint16_t beeps;
+
+  //micros() at start(), and when it finished
+  unsigned long started;
+  unsigned long finished;
+
+  void enterStep(uint8_t step, unsigned long now);
+  bool retry(uint8_t allowed, unsigned long now);
+  bool waitMet(const PC1550MacroStep &step);
+
+ public:
+  //step types
+  enum {
+    SEND,           //queues keys and waits until they are confirmed
+    WAIT_LIGHTS,    //waits until (controller & mask) == value
+    WAIT_PC16OUT,   //waits until (pc16out & mask) == value
+    WAIT_BEEPS,     //waits for value beeps to start
+    END
+  };
+
+  //what update() returns
+  enum {
+    IDLE,
+    RUNNING,
+    DONE,
+    FAILED
+  };
+
+  PC1550Macro(PC1550 &panel);
+
+  //starts running steps, which must end with PC1550_MACRO_END and stay in
+  //place until the macro is done.  Returns false if one is running
+  bool start(const PC1550MacroStep *steps);
+
+  //abandons the macro, dropping any of its keys still queued
+  void stop();
+
+  //moves the macro on.  Returns its state
+  uint8_t update();
+  uint8_t status();
+
+  //the step being run (or that failed), the times keys were sent again,
+  //and how long the macro has run (or ran) in ms
+  uint8_t step();
+  uint16_t retries();
+  unsigned long elapsedMs();
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "PC1550Scanner.h"
+
+PC1550Scanner::PC1550Scanner(){
+  count = 0;
+  clocks = 0;
+  last_sample = 0;
+  pending = 0;
+  ended = 0;
+  unwatched = 0;
+  last_scan = micros();
+}
+
+//the bit a pin occupies in a port sample
+uint32_t PC1550Scanner::pinBit(uint8_t pin){
+#ifdef PC1550_FAST_PORTS
+  //PIND holds pins 0-7, PINB 8-13 and PINC 14-19, packed in that order
+  return (uint32_t)1 << (pin < 14 ? pin : pin + 2);
+#else
+  return (uint32_t)1 << pin;
+#endif
+}
+
+bool PC1550Scanner::addBus(PC1550 &bus){
+  if (count == PC1550_SCANNER_BUSES)
+    return false;
+  buses[count] = &bus;
+  clock_mask[count] = pinBit(bus.clockpin);
+  data_mask[count] = pinBit(bus.datapin);
+  pgm_mask[count] = pinBit(bus.pgmpin);
+  clocks |= clock_mask[count];
+  if (bus.last_clock)
+    last_sample |= clock_mask[count];
+  unwatched |= 1 << count;
+  count++;
+  return true;
+}
+
+uint32_t PC1550Scanner::readPorts(){
+#ifdef PC1550_FAST_PORTS
+  return ((uint32_t)PINC << 16) | ((uint16_t)PINB << 8) | PIND;
+#else
+  uint32_t sample = 0;
+  for (uint8_t i = 0; i < count; i++){
+    if (digitalRead(buses[i]->clockpin)) sample |= clock_mask[i];
+    if (digitalRead(buses[i]->datapin)) sample |= data_mask[i];
+    if (digitalRead(buses[i]->pgmpin)) sample |= pgm_mask[i];
+  }
+  return sample;
+#endif
+}
+
+void PC1550Scanner::scan(){
+  uint32_t sample = readPorts();
+  unsigned long now = micros();
+  uint32_t edges = (sample ^ last_sample) & clocks;
+  last_sample = sample;
+
+  //keep track of the longest stretch the sketch left the buses alone
+  unsigned long gap = now - last_scan;
+  last_scan = now;
+  for (uint8_t i = 0; i < count; i++){
+    PC1550 *bus = buses[i];
+    if (gap > bus->diag.maxPollGapUs)
+      bus->diag.maxPollGapUs = gap;
+    if (gap > bus->bit_period / 2)
+      unwatched |= 1 << i;
+  }
+
+  //the common case: no clock moved and nothing is waiting
+  if (edges == 0 && pending == 0 && ended == 0)
+    return;
+
+  uint8_t work = pending | ended;
+  for (uint8_t i = 0; i < count; i++)
+    if (edges & clock_mask[i])
+      work |= 1 << i;
+
+  pending = 0;
+  ended = 0;
+  for (uint8_t i = 0; work != 0; i++, work >>= 1){
+    if ((work & 1) == 0)
+      continue;
+    PC1550 *bus = buses[i];
+    bool clock = sample & clock_mask[i];
+    bool data = sample & data_mask[i];
+    bool pgmData = sample & pgm_mask[i];
+
+    bus->bTransmissionEnd = false;
+    bus->bHalfFrame = false;
+    bus->traceLines(clock, data, pgmData, now);
+
+    //the first bit after a long idle clock starts a transmission cycle,
+    //if the clock was watched all along.  Otherwise the scans could have
+    //missed bits, so this one is only taken for the first if it is where
+    //the gap after the last frame says (readClockEdge() checks that), and
+    //the bus is found again at the next gap
+    if (clock && clock != bus->last_clock){
+      if (now - bus->last_read > bus->syncIdleUs()){
+        if ((unwatched & (1 << i)) == 0)
+          bus->resetFrame();
+        else if (!bus->gap_timed || bus->controller_bits_read > 0)
+          bus->loseSync();
+      }
+      unwatched &= ~(1 << i);
+    }
+
+    bus->driveBus(bus->readClockEdge(clock, data, pgmData, now));
+
+    if (bus->keypad_sample_pending)
+      pending |= 1 << i;
+    if (bus->bTransmissionEnd || bus->bHalfFrame)
+      ended |= 1 << i;
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef DSC_PC1550_SCANNER_H
+#define DSC_PC1550_SCANNER_H
+
+/*
+ * Decodes several PC1550 buses from one sample of the I/O ports.
+ *
+ * Each bus is an ordinary PC1550 (constructed with its own pins) and keeps
+ * the usual accessors; the scanner just does the polling for all of them.
+ * Instead of three digitalRead()s per bus, scan() reads the ports once and
+ * finds the clock edges on every bus with a single XOR and AND.  Only buses
+ * with a clock edge, a keypad bit waiting to settle, or a frame that just
+ * ended are decoded; an idle sample only times the gap since the last one
+ * for each bus.
+ *
+ *    PC1550 upstairs(A3, A4, A1);
+ *    PC1550 garage(4, 5, 6);
+ *    PC1550Scanner scanner;
+ *
+ *    void setup(){ scanner.addBus(upstairs); scanner.addBus(garage); }
+ *    void loop(){ scanner.scan(); if (garage.keypadStateChanged()) ... }
+ *
+ * On the ATmega328P/168 the sample is PIND, PINB and PINC read back to
+ * back.  Elsewhere it falls back to a digitalRead() per pin.  Buses on a
+ * scanner synchronize on the first bit after a long idle clock that was
+ * sampled at least every half bit, as when polling, and must not be
+ * polled or interrupt driven themselves.  The time between scans is their
+ * maxPollGapUs.  The glitch filter is not applied to scanned buses.
+ */
+
+#include "PC1550.h"
+
+//buses a scanner can hold (at most 8)
+#ifndef PC1550_SCANNER_BUSES
+#define PC1550_SCANNER_BUSES 4
+#endif
+
+//each bus is a bit of a byte
+#if PC1550_SCANNER_BUSES > 8
+#error PC1550_SCANNER_BUSES must be 8 or less
+#endif
+
+class PC1550Scanner {
+
+  PC1550 *buses[PC1550_SCANNER_BUSES];
+  uint8_t count;
+
+  //each bus's lines as bits of a port sample
+  uint32_t clock_mask[PC1550_SCANNER_BUSES];
+  uint32_t data_mask[PC1550_SCANNER_BUSES];
+  uint32_t pgm_mask[PC1550_SCANNER_BUSES];
+
+  //every bus's clock line, and the previous sample
+  uint32_t clocks;
+  uint32_t last_sample;
+
+  //one bit per bus: keypad bits waiting to settle, frames (or first
+  //halves) that ended on the last scan, and idle clocks that went more
+  //than half a bit unsampled since the bus's last bit, so one could have
+  //come and gone unseen
+  uint8_t pending;
+  uint8_t ended;
+  uint8_t unwatched;
+
+  //when the last scan sampled the ports
+  unsigned long last_scan;
+
+  static uint32_t pinBit(uint8_t pin);
+  uint32_t readPorts();
+
+ public:
+  PC1550Scanner();
+
+  //adds a bus, using the pins it was constructed with.  Returns false if
+  //the scanner is full
+  bool addBus(PC1550 &bus);
+
+  //samples every bus once.  Call at least every 750us, like
+  //processClockCycle()
+  void scan();
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "PC1550Telemetry.h"
+
+//CRC-8, polynomial 0x07, initial value 0
+uint8_t PC1550TelemetryCRC(const uint8_t *bytes, uint8_t length){
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < length; i++){
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+/* ==================================================================== */
+/*                               W R I T E R                            */
+/* ==================================================================== */
+
+PC1550TelemetryWriter::PC1550TelemetryWriter(uint16_t keyframeFrames){
+  for (uint8_t i = 0; i < 5; i++)
+    sent[i] = 0;
+  frames = 0;
+  keyframe_frames = keyframeFrames;
+  sequence = 0;
+  keyframe_due = true;
+}
+
+void PC1550TelemetryWriter::requestKeyframe(){
+  keyframe_due = true;
+}
+
+uint8_t PC1550TelemetryWriter::encode(uint16_t controller, uint16_t pc16out,
+                                      uint8_t keypad, uint8_t *packet){
+  uint8_t state[5] = {
+    (uint8_t)(controller >> 8), (uint8_t)controller,
+    (uint8_t)(pc16out >> 8), (uint8_t)pc16out,
+    keypad
+  };
+
+  //0 frames between keyframes sends only the first and requested ones
+  frames++;
+  if (keyframe_frames != 0 && frames >= keyframe_frames)
+    keyframe_due = true;
+
+  uint8_t fields = 0;
+  for (uint8_t i = 0; i < 5; i++)
+    if (keyframe_due || state[i] != sent[i])
+      fields |= 1 << i;
+  if (fields == 0)
+    return 0;
+
+  if (keyframe_due){
+    fields |= PC1550_TELEMETRY_KEYFRAME_FLAG;
+    keyframe_due = false;
+    frames = 0;
+  }
+
+  uint8_t length = 0;
+  packet[length++] = PC1550_TELEMETRY_SYNC;
+  packet[length++] = sequence++;
+  packet[length++] = fields;
+  for (uint8_t i = 0; i < 5; i++)
+    if (fields & (1 << i)){
+      packet[length++] = state[i];
+      sent[i] = state[i];
+    }
+  packet[length] = PC1550TelemetryCRC(packet + 1, length - 1);
+  return length + 1;
+}
+
+/* ==================================================================== */
+/*                               R E A D E R                            */
+/* ==================================================================== */
+
+PC1550TelemetryReader::PC1550TelemetryReader(){
+  length = 0;
+  started = false;
+  controller = 0;
+  pc16out = 0;
+  keypad = 0;
+  valid = false;
+  sequence = 0;
+  keyframe = false;
+  packets = 0;
+  packetsLost = 0;
+  crcErrors = 0;
+}
+
+//the length of the packet in the buffer, known once its fields byte is
+//in.  0 if the fields byte can't start a packet
+uint8_t PC1550TelemetryReader::packetLength(){
+  uint8_t fields = buffer[2];
+  uint8_t data = fields & 0x1f;
+  if ((fields & 0x60) != 0 || data == 0 ||
+      ((fields & PC1550_TELEMETRY_KEYFRAME_FLAG) && data != 0x1f))
+    return 0;
+
+  uint8_t count = 0;
+  for (; data != 0; data >>= 1)
+    count += data & 1;
+  return 3 + count + 1;
+}
+
+uint8_t PC1550TelemetryReader::push(uint8_t byte){
+  //hunt for the sync byte.  A clean stream has nothing between packets,
+  //so anything skipped here is part of a damaged packet whose changes
+  //are now missing
+  if (length == 0 && byte != PC1550_TELEMETRY_SYNC){
+    if (!valid)
+      return MORE;
+    valid = false;
+    return LOST;
+  }
+  buffer[length++] = byte;
+
+  uint8_t expected = 0;
+  if (length >= 3){
+    expected = packetLength();
+    if (expected != 0 && length < expected)
+      return MORE;
+  }
+  else
+    return MORE;
+
+  if (expected != 0 &&
+      PC1550TelemetryCRC(buffer + 1, length - 2) == buffer[length - 1]){
+    length = 0;
+    return apply();
+  }
+
+  //not a packet after all.  Look for the next sync byte among the bytes
+  //already taken, which may well hold a whole packet of their own
+  uint8_t result = valid ? LOST : MORE;
+  valid = false;
+  if (expected != 0){
+    crcErrors++;
+    result = BAD_CRC;
+  }
+  uint8_t held = length;
+  uint8_t bytes[PC1550_TELEMETRY_MAX_PACKET];
+  for (uint8_t i = 0; i < held; i++)
+    bytes[i] = buffer[i];
+  length = 0;
+  for (uint8_t i = 1; i < held; i++){
+    uint8_t found = push(bytes[i]);
+    if (found != MORE)
+      result = found;
+  }
+  return result;
+}
+
+//a packet's bytes are sent back to back, so one still incomplete when
+//the line goes quiet was damaged on the way
+uint8_t PC1550TelemetryReader::idle(){
+  if (length == 0)
+    return MORE;
+  length = 0;
+  crcErrors++;
+  valid = false;
+  return BAD_CRC;
+}
+
+//updates the state from the packet in the buffer
+uint8_t PC1550TelemetryReader::apply(){
+  uint8_t seq = buffer[1];
+  uint8_t fields = buffer[2];
+
+  if (started && seq != (uint8_t)(sequence + 1)){
+    packetsLost += (uint8_t)(seq - sequence - 1);
+    valid = false;
+  }
+  started = true;
+  sequence = seq;
+  keyframe = fields & PC1550_TELEMETRY_KEYFRAME_FLAG;
+  if (keyframe)
+    valid = true;
+  packets++;
+
+  uint8_t state[5] = {
+    (uint8_t)(controller >> 8), (uint8_t)controller,
+    (uint8_t)(pc16out >> 8), (uint8_t)pc16out,
+    keypad
+  };
+  uint8_t next = 3;
+  for (uint8_t i = 0; i < 5; i++)
+    if (fields & (1 << i))
+      state[i] = buffer[next++];
+  controller = (uint16_t)state[0] << 8 | state[1];
+  pc16out = (uint16_t)state[2] << 8 | state[3];
+  keypad = state[4];
+
+  return valid ? UPDATE : LOST;
+}
@@ -0,0 +1,128 @@
+#ifndef DSC_PC1550_TELEMETRY_H
+#define DSC_PC1550_TELEMETRY_H
+
+/*
+ * Compact binary telemetry of the decoded panel state.
+ *
+ * Instead of printing the accessors as text, a sketch can send the state
+ * of each frame as a small packet, and only when something changed:
+ *
+ *     0xA5  seq  fields  [data bytes]  crc
+ *
+ * seq counts packets (modulo 256) so the receiver can tell when one was
+ * lost.  fields says which of the five state bytes follow, in this order:
+ *
+ *     0x01  controller bits 15-8 (zone lights)
+ *     0x02  controller bits 7-0 (state lights, beep)
+ *     0x04  PC16-OUT bits 15-8 (zones tripped)
+ *     0x08  PC16-OUT bits 7-0
+ *     0x10  keypad byte
+ *
+ * A delta carries only the bytes that changed since the previous packet.
+ * A keyframe (0x80 set in fields) carries all five, and is sent first, then
+ * every PC1550_TELEMETRY_KEYFRAME frames, so a receiver that starts late or
+ * loses a packet is back in step within a few seconds.  crc is a CRC-8
+ * (polynomial 0x07) of seq, fields and the data bytes.
+ *
+ * An unchanged frame costs nothing, a zone opening costs 5 bytes and a
+ * keyframe 9, against 15 or more for a line of text per frame.  Any 0xA5
+ * inside a packet is only a candidate sync byte: the reader rejects it on
+ * the fields byte or the CRC and carries on looking.
+ */
+
+#include <stdint.h>
+
+#define PC1550_TELEMETRY_SYNC 0xA5
+#define PC1550_TELEMETRY_MAX_PACKET 9
+
+//frames between keyframes
+#ifndef PC1550_TELEMETRY_KEYFRAME
+#define PC1550_TELEMETRY_KEYFRAME 64
+#endif
+
+//bits of the fields byte
+#define PC1550_TELEMETRY_CONTROLLER_HI 0x01
+#define PC1550_TELEMETRY_CONTROLLER_LO 0x02
+#define PC1550_TELEMETRY_PC16OUT_HI    0x04
+#define PC1550_TELEMETRY_PC16OUT_LO    0x08
+#define PC1550_TELEMETRY_KEYPAD        0x10
+#define PC1550_TELEMETRY_KEYFRAME_FLAG 0x80
+
+uint8_t PC1550TelemetryCRC(const uint8_t *bytes, uint8_t length);
+
+//Encodes one packet per frame for the sketch to write to Serial:
+//
+//    PC1550::Snapshot snap = alarm.snapshot();
+//    uint8_t packet[PC1550_TELEMETRY_MAX_PACKET];
+//    Serial.write(packet, telemetry.encode(snap.controller, snap.pc16out,
+//                                          snap.keypad, packet));
+class PC1550TelemetryWriter {
+
+  //the state last sent, frames since the last keyframe and the next
+  //packet's sequence number
+  uint8_t sent[5];
+  uint16_t frames;
+  uint16_t keyframe_frames;
+  uint8_t sequence;
+  bool keyframe_due;
+
+ public:
+  PC1550TelemetryWriter(uint16_t keyframeFrames = PC1550_TELEMETRY_KEYFRAME);
+
+  //encodes the state of a frame into packet (PC1550_TELEMETRY_MAX_PACKET
+  //bytes) and returns its length, or 0 when there is nothing to send.
+  //Call it once per frame
+  uint8_t encode(uint16_t controller, uint16_t pc16out, uint8_t keypad,
+                 uint8_t *packet);
+
+  //makes the next packet a keyframe
+  void requestKeyframe();
+};
+
+//Decodes a telemetry stream one byte at a time
+class PC1550TelemetryReader {
+
+  uint8_t buffer[PC1550_TELEMETRY_MAX_PACKET];
+  uint8_t length;
+  bool started;
+
+  uint8_t packetLength();
+  uint8_t apply();
+
+ public:
+  PC1550TelemetryReader();
+
+  //what push() found
+  enum {
+    MORE,     //the byte was consumed, nothing complete yet
+    UPDATE,   //a packet was applied to the state below
+    LOST,     //packets were lost; state is stale until the next keyframe
+    BAD_CRC   //a packet failed its CRC and was skipped
+  };
+
+  uint8_t push(uint8_t byte);
+
+  //call when nothing has arrived for a while (a few byte times or more)
+  //so that a packet cut short is caught before the next one arrives.
+  //Returns BAD_CRC if one was, otherwise MORE
+  uint8_t idle();
+
+  //the panel state as of the latest packet.  valid is false until the
+  //first keyframe, and again from a lost or damaged packet to the next
+  //keyframe
+  uint16_t controller;
+  uint16_t pc16out;
+  uint8_t keypad;
+  bool valid;
+
+  //the latest packet's sequence number and whether it was a keyframe
+  uint8_t sequence;
+  bool keyframe;
+
+  //running counts of good packets, packets lost and CRC failures
+  uint32_t packets;
+  uint32_t packetsLost;
+  uint32_t crcErrors;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "PC1550Trace.h"
+#include "PC1550.h"
+
+static const uint8_t header[PC1550_TRACE_HEADER_SIZE] = {
+  'P', '1', '5', 'T', PC1550_TRACE_VERSION, PC1550_TRACE_TICK_US
+};
+
+//the most ticks a record's 32 bit value has room for next to the lines
+static const uint32_t maxTicks = 0x1FFFFFFFUL;
+
+/* ==================================================================== */
+/*                               W R I T E R                            */
+/* ==================================================================== */
+
+PC1550TraceWriter::PC1550TraceWriter(uint8_t *buffer, uint16_t size){
+  this->buffer = buffer;
+  this->size = size;
+  head = 0;
+  tail = 0;
+  last_lines = 0;
+  last_time = 0;
+  started = false;
+  gap_pending = false;
+  bytes_dropped = 0;
+}
+
+void PC1550TraceWriter::begin(){
+  for (uint8_t i = 0; i < PC1550_TRACE_HEADER_SIZE; i++)
+    put(header[i]);
+  started = false;
+}
+
+//free bytes in the ring (one slot is always left empty)
+uint16_t PC1550TraceWriter::space(){
+  uint16_t used = head >= tail ? head - tail : size - tail + head;
+  return size - 1 - used;
+}
+
+void PC1550TraceWriter::put(uint8_t byte){
+  buffer[head] = byte;
+  head = head + 1 == size ? 0 : head + 1;
+}
+
+//writes one record, after the gap marker if one is owed.  Returns false
+//if it didn't fit
+bool PC1550TraceWriter::record(uint32_t value){
+  uint8_t length = 1;
+  for (uint32_t v = value >> 7; v != 0; v >>= 7)
+    length++;
+
+  if (gap_pending){
+    if (space() < (uint16_t)length + 2){
+      bytes_dropped += length;
+      return false;
+    }
+    put(0x80);
+    put(0x00);
+    gap_pending = false;
+  }
+  else if (space() < length){
+    bytes_dropped += length;
+    gap_pending = true;
+    return false;
+  }
+
+  while (value >= 0x80){
+    put((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  put((uint8_t)value);
+  return true;
+}
+
+void PC1550TraceWriter::sample(bool clock, bool data, bool pgm,
+                               unsigned long now){
+  uint8_t lines = (clock ? PC1550_TRACE_CLOCK : 0) |
+    (data ? PC1550_TRACE_DATA : 0) | (pgm ? PC1550_TRACE_PGM : 0);
+  if (started && lines == last_lines)
+    return;
+
+  //whole ticks only, so rounding never accumulates
+  uint32_t ticks = started ? (now - last_time) / PC1550_TRACE_TICK_US : 0;
+
+  //more than a record can hold goes in records of the unchanged lines
+  while (ticks > maxTicks){
+    if (!record((maxTicks << 3) | last_lines))
+      return;
+    last_time += maxTicks * PC1550_TRACE_TICK_US;
+    ticks -= maxTicks;
+  }
+
+  if (!record((ticks << 3) | lines))
+    return;
+
+  last_lines = lines;
+  last_time += ticks * PC1550_TRACE_TICK_US;
+  if (!started){
+    last_time = now;
+    started = true;
+  }
+}
+
+uint16_t PC1550TraceWriter::available(){
+  noInterrupts();
+  uint16_t h = head;
+  interrupts();
+  return h >= tail ? h - tail : size - tail + h;
+}
+
+int PC1550TraceWriter::read(){
+  if (available() == 0)
+    return -1;
+  uint8_t byte = buffer[tail];
+  uint16_t next = tail + 1 == size ? 0 : tail + 1;
+  noInterrupts();
+  tail = next;
+  interrupts();
+  return byte;
+}
+
+uint16_t PC1550TraceWriter::read(uint8_t *dest, uint16_t max){
+  uint16_t count = available();
+  if (count > max)
+    count = max;
+  uint16_t next = tail;
+  for (uint16_t i = 0; i < count; i++){
+    dest[i] = buffer[next];
+    next = next + 1 == size ? 0 : next + 1;
+  }
+  noInterrupts();
+  tail = next;
+  interrupts();
+  return count;
+}
+
+uint32_t PC1550TraceWriter::bytesDropped(){
+  noInterrupts();
+  uint32_t dropped = bytes_dropped;
+  interrupts();
+  return dropped;
+}
+
+/* ==================================================================== */
+/*                               R E A D E R                            */
+/* ==================================================================== */
+
+PC1550TraceReader::PC1550TraceReader(){
+  header_read = 0;
+  value = 0;
+  shift = 0;
+  time = 0;
+  lines = 0;
+}
+
+uint8_t PC1550TraceReader::push(uint8_t byte){
+  if (header_read < PC1550_TRACE_HEADER_SIZE){
+    if (byte != header[header_read])
+      return BAD_HEADER;
+    header_read++;
+    return MORE;
+  }
+
+  //the encoder never ends a record with an empty byte, so one can only
+  //close a gap marker
+  if (byte == 0x00 && shift != 0){
+    value = 0;
+    shift = 0;
+    return GAP;
+  }
+
+  value |= (uint32_t)(byte & 0x7f) << shift;
+  if (byte & 0x80){
+    shift += 7;
+    return MORE;
+  }
+
+  time += (value >> 3) * PC1550_TRACE_TICK_US;
+  lines = value & 0x07;
+  value = 0;
+  shift = 0;
+  return RECORD;
+}
@@ -0,0 +1,106 @@
+#ifndef DSC_PC1550_TRACE_H
+#define DSC_PC1550_TRACE_H
+
+/*
+ * Compact binary traces of the raw PC1550 bus.
+ *
+ * A trace starts with a 6 byte header: "P15T", a format version and the
+ * size of a time tick in microseconds.  Every change seen on the clock,
+ * data and PGM lines then follows as one record:
+ *
+ *     varint( ticks since the previous record << 3 | lines )
+ *
+ * where lines packs clock (bit 0), data (bit 1) and PGM (bit 2), and the
+ * varint is little endian base-128 (7 bits per byte, high bit set on all
+ * but the last byte).  A tick is 4us, the resolution of micros() on a
+ * 16MHz AVR, so an edge within a transmission takes 2 bytes and the sync
+ * gap 3 bytes: roughly 1.5KB per second of panel traffic.  A record holds
+ * at most 2^29 - 1 ticks (about 35 minutes), so a longer wait without a
+ * change is split up by records that repeat the lines.
+ *
+ * If the writer's buffer overflows, the records that didn't fit are lost
+ * and a gap marker (0x80 0x00, which the encoder never produces otherwise)
+ * is written once there is room.  Times stay accurate across a gap; only
+ * the changes in between are missing.
+ */
+
+#include <stdint.h>
+
+#define PC1550_TRACE_VERSION 1
+#define PC1550_TRACE_TICK_US 4
+#define PC1550_TRACE_HEADER_SIZE 6
+
+//line bits in a trace record
+#define PC1550_TRACE_CLOCK 0x01
+#define PC1550_TRACE_DATA  0x02
+#define PC1550_TRACE_PGM   0x04
+
+//Encodes line changes into a caller supplied ring buffer that the sketch
+//drains (to Serial, an SD card, ...) with read().  sample() may be called
+//from an interrupt handler while the main loop reads: it is the only
+//writer of head, and read() the only writer of tail, which it updates
+//with interrupts held off since it takes more than one instruction.
+class PC1550TraceWriter {
+
+  uint8_t *buffer;
+  uint16_t size;
+  volatile uint16_t head;
+  volatile uint16_t tail;
+
+  //the lines and time of the last record written
+  uint8_t last_lines;
+  unsigned long last_time;
+  bool started;
+
+  //set when records were lost and a gap marker is still owed
+  bool gap_pending;
+  volatile uint32_t bytes_dropped;
+
+  uint16_t space();
+  void put(uint8_t byte);
+  bool record(uint32_t value);
+
+ public:
+  PC1550TraceWriter(uint8_t *buffer, uint16_t size);
+
+  //writes the header.  Call once before the first sample
+  void begin();
+
+  //records the lines if any of them changed since the last sample
+  void sample(bool clock, bool data, bool pgm, unsigned long now);
+
+  //buffered trace bytes, drained oldest first
+  uint16_t available();
+  int read();
+  uint16_t read(uint8_t *dest, uint16_t max);
+
+  //trace bytes lost because the buffer was not drained in time
+  uint32_t bytesDropped();
+};
+
+//Decodes a trace one byte at a time
+class PC1550TraceReader {
+
+  uint8_t header_read;
+  uint32_t value;
+  uint8_t shift;
+
+ public:
+  PC1550TraceReader();
+
+  //what push() found
+  enum {
+    MORE,       //the byte was consumed, nothing complete yet
+    RECORD,     //a record is ready in time/lines
+    GAP,        //records were lost here
+    BAD_HEADER  //not a trace this reader understands
+  };
+
+  uint8_t push(uint8_t byte);
+
+  //the latest record: microseconds since the first record, and the lines
+  unsigned long time;
+  uint8_t lines;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "PC1550Gpio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+unsigned long PC1550MonotonicMicros(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+//a busy wait: sleeping would overshoot the few microseconds asked for
+static void spinMicros(unsigned int us){
+  unsigned long start = PC1550MonotonicMicros();
+  while (PC1550MonotonicMicros() - start < us)
+    ;
+}
+
+/* ==================================================================== */
+/*                        L I N U X    G P I O                          */
+/* ==================================================================== */
+
+//lines in the request, in this order
+enum { DATA_LINE, CLOCK_LINE, PGM_LINE };
+
+PC1550LinuxGpio::PC1550LinuxGpio(const char *chip, uint8_t datapin,
+                                 uint8_t clockpin, uint8_t pgmpin){
+  this->chip = chip;
+  pins[DATA_LINE] = datapin;
+  pins[CLOCK_LINE] = clockpin;
+  pins[PGM_LINE] = pgmpin;
+  line_fd = -1;
+  data_level = LOW;
+  data_output = false;
+}
+
+PC1550LinuxGpio::~PC1550LinuxGpio(){
+  if (line_fd >= 0)
+    close(line_fd);
+}
+
+bool PC1550LinuxGpio::open(){
+  int chip_fd = ::open(chip, O_RDWR | O_CLOEXEC);
+  if (chip_fd < 0)
+    return false;
+
+  struct gpio_v2_line_request request;
+  memset(&request, 0, sizeof(request));
+  for (uint8_t i = 0; i < 3; i++)
+    request.offsets[i] = pins[i];
+  request.num_lines = 3;
+  strncpy(request.consumer, "pc1550", sizeof(request.consumer) - 1);
+  request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+
+  int result = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request);
+  int error = errno;
+  close(chip_fd);
+  if (result < 0){
+    errno = error;
+    return false;
+  }
+  line_fd = request.fd;
+  return true;
+}
+
+int PC1550LinuxGpio::lineIndex(uint8_t pin){
+  for (uint8_t i = 0; i < 3; i++)
+    if (pins[i] == pin)
+      return i;
+  return -1;
+}
+
+//applies the data line's mode: all lines are inputs, except the data
+//line while it is driven
+bool PC1550LinuxGpio::configure(){
+  struct gpio_v2_line_config config;
+  memset(&config, 0, sizeof(config));
+  config.flags = GPIO_V2_LINE_FLAG_INPUT;
+  if (data_output){
+    config.num_attrs = 2;
+    config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+    config.attrs[0].attr.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    config.attrs[0].mask = 1ULL << DATA_LINE;
+    config.attrs[1].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    config.attrs[1].attr.values = (uint64_t)data_level << DATA_LINE;
+    config.attrs[1].mask = 1ULL << DATA_LINE;
+  }
+  return ioctl(line_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) == 0;
+}
+
+int PC1550LinuxGpio::digitalRead(uint8_t pin){
+  int index = lineIndex(pin);
+  if (index < 0 || line_fd < 0)
+    return LOW;
+  struct gpio_v2_line_values values;
+  values.bits = 0;
+  values.mask = 1ULL << index;
+  if (ioctl(line_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+    return LOW;
+  return (values.bits >> index) & 1 ? HIGH : LOW;
+}
+
+//only the data line is ever driven by the library
+void PC1550LinuxGpio::pinMode(uint8_t pin, uint8_t mode){
+  if (lineIndex(pin) != DATA_LINE || line_fd < 0)
+    return;
+  bool output = mode == OUTPUT;
+  if (output != data_output){
+    data_output = output;
+    configure();
+  }
+}
+
+void PC1550LinuxGpio::digitalWrite(uint8_t pin, uint8_t value){
+  if (lineIndex(pin) != DATA_LINE)
+    return;
+  data_level = value;
+  if (data_output && line_fd >= 0)
+    configure();
+}
+
+unsigned long PC1550LinuxGpio::micros(){
+  return PC1550MonotonicMicros();
+}
+
+void PC1550LinuxGpio::delayMicroseconds(unsigned int us){
+  spinMicros(us);
+}
+
+/* ==================================================================== */
+/*                    R E A L    T I M E    S I M                       */
+/* ==================================================================== */
+
+PC1550RealTimeSim::PC1550RealTimeSim(PC1550Sim &sim){
+  this->sim = &sim;
+  start = PC1550MonotonicMicros() - sim.micros();
+}
+
+//moves the simulated panel on to the present
+void PC1550RealTimeSim::catchUp(){
+  unsigned long now = PC1550MonotonicMicros() - start;
+  if ((long)(now - sim->micros()) > 0)
+    sim->advance(now - sim->micros());
+}
+
+int PC1550RealTimeSim::digitalRead(uint8_t pin){
+  catchUp();
+  return sim->digitalRead(pin);
+}
+
+void PC1550RealTimeSim::pinMode(uint8_t pin, uint8_t mode){
+  catchUp();
+  sim->pinMode(pin, mode);
+}
+
+void PC1550RealTimeSim::digitalWrite(uint8_t pin, uint8_t value){
+  catchUp();
+  sim->digitalWrite(pin, value);
+}
+
+unsigned long PC1550RealTimeSim::micros(){
+  catchUp();
+  return sim->micros();
+}
+
+void PC1550RealTimeSim::delayMicroseconds(unsigned int us){
+  spinMicros(us);
+  catchUp();
+}
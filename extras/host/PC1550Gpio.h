@@ -0,0 +1,87 @@
+#ifndef DSC_PC1550_GPIO_H
+#define DSC_PC1550_GPIO_H
+
+/*
+ * Backends that run the decoder against real time on a Linux host.
+ *
+ * PC1550LinuxGpio reads the bus from three lines of a GPIO chip through
+ * the kernel's GPIO character device (/dev/gpiochipN), so a PC1550 can run
+ * on a single board computer such as a Raspberry Pi with level shifting to
+ * the 5V keypad bus in between.  The library's pin numbers are the line
+ * offsets on the chip:
+ *
+ *     PC1550LinuxGpio gpio("/dev/gpiochip0", 17, 27, 22);  //data, clock, PGM
+ *     if (gpio.open()) {
+ *       PC1550SetBackend(&gpio);
+ *       PC1550 panel(17, 27, 22);
+ *       ...
+ *     }
+ *
+ * PC1550RealTimeSim stands in for it with no hardware attached: it runs
+ * a PC1550Sim, keeping the simulated panel in step with the monotonic
+ * clock, so timing and throughput on the host can be checked exactly as
+ * they would be with a real panel.
+ *
+ * Both keep micros() on CLOCK_MONOTONIC and busy-wait in
+ * delayMicroseconds(), and neither raises interrupts: run the decoder
+ * from a PC1550Thread.
+ */
+
+#include "PC1550.h"
+#include "PC1550Sim.h"
+
+//microseconds on CLOCK_MONOTONIC, the time base of both backends and of
+//PC1550Thread
+unsigned long PC1550MonotonicMicros();
+
+class PC1550LinuxGpio : public PC1550Backend {
+
+  const char *chip;
+  uint8_t pins[3];
+  int line_fd;
+
+  //the data line's digitalWrite() level and whether it is being driven
+  uint8_t data_level;
+  bool data_output;
+
+  int lineIndex(uint8_t pin);
+  bool configure();
+
+ public:
+  PC1550LinuxGpio(const char *chip, uint8_t datapin, uint8_t clockpin,
+                  uint8_t pgmpin);
+  ~PC1550LinuxGpio();
+
+  //requests the three lines as inputs.  Returns false (with errno set) if
+  //the chip or a line isn't available
+  bool open();
+
+  //PC1550Backend
+  int digitalRead(uint8_t pin);
+  void pinMode(uint8_t pin, uint8_t mode);
+  void digitalWrite(uint8_t pin, uint8_t value);
+  unsigned long micros();
+  void delayMicroseconds(unsigned int us);
+};
+
+class PC1550RealTimeSim : public PC1550Backend {
+
+  PC1550Sim *sim;
+  unsigned long start;
+
+  void catchUp();
+
+ public:
+  //the simulation starts at the current time.  Only the thread running
+  //the decoder may touch sim from then on
+  PC1550RealTimeSim(PC1550Sim &sim);
+
+  //PC1550Backend
+  int digitalRead(uint8_t pin);
+  void pinMode(uint8_t pin, uint8_t mode);
+  void digitalWrite(uint8_t pin, uint8_t value);
+  unsigned long micros();
+  void delayMicroseconds(unsigned int us);
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "PC1550Replay.h"
+
+PC1550Replay::PC1550Replay(uint8_t datapin, uint8_t clockpin, uint8_t pgmpin){
+  this->datapin = datapin;
+  this->clockpin = clockpin;
+  this->pgmpin = pgmpin;
+  panel = 0;
+  now = 0;
+  lines = 0;
+  settle_pending = false;
+  settle_time = 0;
+  records = 0;
+  gaps = 0;
+  frames = 0;
+  bad = false;
+}
+
+void PC1550Replay::attach(PC1550 *panel){
+  this->panel = panel;
+}
+
+bool PC1550Replay::feed(const uint8_t *bytes, unsigned long length){
+  for (unsigned long i = 0; i < length && !bad; i++){
+    switch (reader.push(bytes[i]))
+      {
+      case PC1550TraceReader::RECORD:
+        //poll once the line has settled after the previous change, then
+        //keep polling through long idle stretches often enough for the
+        //decoder to sync on them, until this change is due
+        if (settle_pending){
+          for (unsigned long t = settle_time; t < reader.time; t += PC1550_REPLAY_IDLE_POLL_US){
+            now = t;
+            poll();
+          }
+        }
+        now = reader.time;
+        lines = reader.lines;
+        records++;
+        poll();
+        settle_pending = true;
+        settle_time = now + PC1550_KEYPAD_SETTLE_US;
+        break;
+      case PC1550TraceReader::GAP:
+        gaps++;
+        break;
+      case PC1550TraceReader::BAD_HEADER:
+        bad = true;
+        break;
+      }
+  }
+  return !bad;
+}
+
+void PC1550Replay::poll(){
+  panel->processClockCycle();
+  if (panel->atTransmissionEnd())
+    frames++;
+}
+
+unsigned long PC1550Replay::framesDecoded(){
+  return frames;
+}
+
+unsigned long PC1550Replay::recordsReplayed(){
+  return records;
+}
+
+unsigned long PC1550Replay::gapsSeen(){
+  return gaps;
+}
+
+int PC1550Replay::digitalRead(uint8_t pin){
+  if (pin == clockpin)
+    return (lines & PC1550_TRACE_CLOCK) ? HIGH : LOW;
+  if (pin == datapin)
+    return (lines & PC1550_TRACE_DATA) ? HIGH : LOW;
+  if (pin == pgmpin)
+    return (lines & PC1550_TRACE_PGM) ? HIGH : LOW;
+  return LOW;
+}
+
+void PC1550Replay::pinMode(uint8_t, uint8_t){
+}
+
+void PC1550Replay::digitalWrite(uint8_t, uint8_t){
+}
+
+unsigned long PC1550Replay::micros(){
+  return now;
+}
+
+void PC1550Replay::delayMicroseconds(unsigned int us){
+  now += us;
+}
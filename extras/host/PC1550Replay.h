@@ -0,0 +1,71 @@
+#ifndef DSC_PC1550_REPLAY_H
+#define DSC_PC1550_REPLAY_H
+
+/*
+ * Replays a recorded bus trace (see PC1550Trace.h) through the decoder.
+ *
+ * PC1550Replay is a PC1550Backend whose lines and clock come from the
+ * trace.  Install it with PC1550SetBackend() before constructing the
+ * PC1550, then hand it trace bytes with feed().  processClockCycle() is
+ * called once per recorded change, once more PC1550_KEYPAD_SETTLE_US
+ * later, and then every PC1550_REPLAY_IDLE_POLL_US until the next change
+ * (so the sync gap is seen).  That is what a decoder polled without delay
+ * would see.  Nothing waits on real time, so replay runs as fast as the
+ * decoder can go.
+ *
+ * The data line reads as recorded: the emulator can't drive it during
+ * replay, since the recording already contains whatever was driven.
+ */
+
+#include "PC1550.h"
+#include "PC1550Trace.h"
+
+//polling interval through idle stretches of a trace.  The decoder only
+//syncs on an idle clock watched at least every half bit period
+#define PC1550_REPLAY_IDLE_POLL_US 500
+
+class PC1550Replay : public PC1550Backend {
+
+  PC1550 *panel;
+  PC1550TraceReader reader;
+  uint8_t datapin;
+  uint8_t clockpin;
+  uint8_t pgmpin;
+
+  unsigned long now;
+  uint8_t lines;
+
+  //a settle poll is owed at this time
+  bool settle_pending;
+  unsigned long settle_time;
+
+  unsigned long records;
+  unsigned long gaps;
+  unsigned long frames;
+  bool bad;
+
+  void poll();
+
+ public:
+  PC1550Replay(uint8_t datapin = A3, uint8_t clockpin = A4, uint8_t pgmpin = A1);
+
+  //the decoder to drive; set once it has been constructed
+  void attach(PC1550 *panel);
+
+  //decodes trace bytes, driving the panel through every record.  Returns
+  //false once the trace turns out not to be one
+  bool feed(const uint8_t *bytes, unsigned long length);
+
+  unsigned long recordsReplayed();
+  unsigned long gapsSeen();
+  unsigned long framesDecoded();
+
+  //PC1550Backend
+  int digitalRead(uint8_t pin);
+  void pinMode(uint8_t pin, uint8_t mode);
+  void digitalWrite(uint8_t pin, uint8_t value);
+  unsigned long micros();
+  void delayMicroseconds(unsigned int us);
+};
+
+#endif
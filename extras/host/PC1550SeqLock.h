@@ -0,0 +1,56 @@
+#ifndef DSC_PC1550_SEQLOCK_H
+#define DSC_PC1550_SEQLOCK_H
+
+/*
+ * A value with one writer and any number of lock-free readers.
+ *
+ * The writer makes the sequence odd while it copies a new value in and
+ * even again when it is done.  A reader copies the value out and tries
+ * again if the sequence was odd or changed under it, so it always gets a
+ * whole value and the writer never waits on a reader.  T must be plain
+ * data (copied with memcpy), and all-zero memory is a valid empty lock,
+ * so one can live in a freshly created shared memory segment.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+template <typename T>
+class PC1550SeqLock {
+
+  std::atomic<uint32_t> sequence;
+  T value;
+
+ public:
+  PC1550SeqLock() : sequence(0) {
+    memset(&value, 0, sizeof(value));
+  }
+
+  void write(const T &next){
+    uint32_t s = sequence.load(std::memory_order_relaxed);
+    sequence.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&value, &next, sizeof(value));
+    sequence.store(s + 2, std::memory_order_release);
+  }
+
+  void read(T &copy) const {
+    for (;;){
+      uint32_t before = sequence.load(std::memory_order_acquire);
+      if (before & 1)
+        continue;
+      memcpy(&copy, &value, sizeof(value));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence.load(std::memory_order_relaxed) == before)
+        return;
+    }
+  }
+
+  //the number of values written so far
+  uint32_t writes() const {
+    return sequence.load(std::memory_order_acquire) / 2;
+  }
+};
+
+#endif
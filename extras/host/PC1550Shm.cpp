@@ -0,0 +1,50 @@
+#include "PC1550Shm.h"
+
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PC1550Shm *PC1550ShmOpen(const char *name, bool create){
+  int fd = shm_open(name, create ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+  if (fd < 0)
+    return 0;
+  if (create && ftruncate(fd, sizeof(PC1550Shm)) != 0){
+    close(fd);
+    return 0;
+  }
+
+  //a segment the daemon hasn't sized yet would fault on the first read
+  struct stat st;
+  if (!create && (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PC1550Shm))){
+    close(fd);
+    errno = EAGAIN;
+    return 0;
+  }
+
+  //readers map the segment read only, so a misbehaving one can't corrupt
+  //what the others see
+  void *mem = mmap(0, sizeof(PC1550Shm), create ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+    return 0;
+
+  PC1550Shm *shm = (PC1550Shm *)mem;
+  if (create){
+    shm->magic = 0;
+    shm->version = PC1550_SHM_VERSION;
+    shm->writerPid = getpid();
+    PC1550ShmState empty;
+    memset(&empty, 0, sizeof(empty));
+    PC1550ShmWrite(shm, empty);
+    shm->magic = PC1550_SHM_MAGIC;
+  }
+  return shm;
+}
+
+void PC1550ShmClose(PC1550Shm *shm){
+  munmap(shm, sizeof(PC1550Shm));
+}
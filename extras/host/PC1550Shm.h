@@ -0,0 +1,72 @@
+#ifndef DSC_PC1550_SHM_H
+#define DSC_PC1550_SHM_H
+
+/*
+ * Panel state shared between processes on a Linux host.
+ *
+ * pc1550d decodes the panel and publishes every frame into a POSIX shared
+ * memory segment (/pc1550 by default).  Any number of local processes can
+ * map the segment and take a consistent snapshot of the state without
+ * locking or system calls:
+ *
+ *     PC1550Shm *shm = PC1550ShmOpen("/pc1550", false);
+ *     PC1550ShmState state;
+ *     if (shm != 0 && PC1550ShmRead(shm, state) && state.valid) ...
+ *
+ * The state is guarded by a sequence lock (see PC1550SeqLock.h), so a
+ * read is a copy of a few dozen bytes and two loads.  Readers never write
+ * to the segment, so however many there are they cannot slow the daemon
+ * down.
+ */
+
+#include <stdint.h>
+
+#include "PC1550SeqLock.h"
+
+#define PC1550_SHM_NAME "/pc1550"
+#define PC1550_SHM_MAGIC 0x53353150 //"P15S"
+#define PC1550_SHM_VERSION 1
+
+//the state as of the latest frame
+struct PC1550ShmState {
+  uint16_t controller;         //light bits, see PC1550::ZONE1_LIGHT ...
+  uint16_t pc16out;            //PC16-OUT bits, see PC1550::PGM_OUTPUT ...
+  uint8_t keypad;              //raw key bits on the bus, 0 for none
+  uint8_t valid;               //0 until the state can be trusted
+  uint16_t controllerChanged;  //bits that differ from the previous update
+  uint16_t pc16outChanged;
+  uint8_t keypadChanged;
+  uint16_t consecutiveBeeps;   //0 when fed by telemetry
+  uint16_t consecutiveKeyPresses;
+  uint32_t updates;            //updates published so far
+  uint64_t updatedNs;          //CLOCK_MONOTONIC time of the latest update
+  uint32_t packetsLost;        //telemetry packets lost or damaged
+};
+
+struct PC1550Shm {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t writerPid;          //the daemon publishing, 0 once it has exited
+  PC1550SeqLock<PC1550ShmState> state;
+};
+
+//maps the named segment, creating it (for the daemon) when create is set.
+//Returns 0 on failure with errno set
+PC1550Shm *PC1550ShmOpen(const char *name, bool create);
+void PC1550ShmClose(PC1550Shm *shm);
+
+//publishes a new state.  Only one process may write
+inline void PC1550ShmWrite(PC1550Shm *shm, const PC1550ShmState &state){
+  shm->state.write(state);
+}
+
+//copies a consistent state.  Returns false if the segment isn't one
+//written by pc1550d
+inline bool PC1550ShmRead(const PC1550Shm *shm, PC1550ShmState &state){
+  if (shm->magic != PC1550_SHM_MAGIC || shm->version != PC1550_SHM_VERSION)
+    return false;
+  shm->state.read(state);
+  return true;
+}
+
+#endif
@@ -0,0 +1,312 @@
+#include "PC1550Sim.h"
+
+//the keypad bits for each key, as sent on the bus
+static uint8_t keyBits(char key){
+  switch(key)
+    {
+    case '1': return 0b01000001;
+    case '2': return 0b00100001;
+    case '3': return 0b00010001;
+    case '4': return 0b01000010;
+    case '5': return 0b00100010;
+    case '6': return 0b00010010;
+    case '7': return 0b01000100;
+    case '8': return 0b00100100;
+    case '9': return 0b00010100;
+    case '*': return 0b01001000;
+    case '0': return 0b00101000;
+    case '#': return 0b00011000;
+    case 'F': return 0b01000000;
+    case 'A': return 0b00100000;
+    case 'P': return 0b00010000;
+    default: return 0;
+    }
+}
+
+static char keyChar(uint8_t bits){
+  const char *keys = "123456789*0#FAP";
+  for (const char *k = keys; *k; k++)
+    if (keyBits(*k) == bits)
+      return *k;
+  return '?';
+}
+
+PC1550Sim::PC1550Sim(uint8_t datapin, uint8_t clockpin, uint8_t pgmpin){
+  this->datapin = datapin;
+  this->clockpin = clockpin;
+  this->pgmpin = pgmpin;
+
+  syncGapUs = 26500;
+  bitPeriodUs = 1550;
+  jitterUs = 0;
+  glitchOneIn = 0;
+
+  now = 0;
+  frame_controller = next_controller = 0;
+  frame_pc16out = next_pc16out = 0;
+  keypad_rx = last_keypad_rx = 0;
+  beep_ack = false;
+  keypad_key = 0;
+  keypad_cycles = 0;
+  keypad_presented = false;
+  data_mode = INPUT;
+  data_level = HIGH;
+  received[0] = '\0';
+  received_len = 0;
+  frames = 0;
+  seed = 1;
+  wakeups = 0;
+  glitch_seed = 7;
+
+  phase = -1;
+  phase_end = syncGapUs;
+}
+
+//spreads a phase duration by up to +/- jitterUs
+unsigned long PC1550Sim::jitter(unsigned long duration){
+  if (jitterUs == 0)
+    return duration;
+  seed = seed * 1103515245 + 12345;
+  long offset = (long)((seed >> 16) % (2 * jitterUs + 1)) - (long)jitterUs;
+  return duration + offset;
+}
+
+//now and then flips a level read from a line
+int PC1550Sim::glitch(int level){
+  if (glitchOneIn == 0)
+    return level;
+  glitch_seed = glitch_seed * 1103515245 + 12345;
+  if ((glitch_seed >> 8) % glitchOneIn != 0)
+    return level;
+  return level == HIGH ? LOW : HIGH;
+}
+
+void PC1550Sim::setControllerData(uint16_t word){
+  next_controller = word;
+}
+
+void PC1550Sim::setPC16OutData(uint16_t word){
+  next_pc16out = word;
+}
+
+bool PC1550Sim::pressKey(char key, uint8_t cycles){
+  uint8_t bits = keyBits(key);
+  if (bits == 0)
+    return false;
+  keypad_key = bits;
+  keypad_cycles = cycles;
+  return true;
+}
+
+//the level on the data line right now
+bool PC1550Sim::dataLine(){
+  bool line = HIGH;
+
+  //while the clock is HIGH the panel pulls the line low for a zero bit
+  if (phase >= 0 && (phase & 1) == 0)
+    line = (frame_controller >> (15 - phase / 2)) & 1;
+
+  //while the clock is LOW after one of the first seven bits, keypads
+  //pull the line low for their one bits
+  if (phase >= 0 && (phase & 1) == 1 && phase / 2 < 7 && keypad_cycles > 0)
+    if ((keypad_key >> (6 - phase / 2)) & 1)
+      line = LOW;
+
+  //the emulator pulls the line low whenever its pin is an output
+  if (data_mode == OUTPUT && data_level == LOW)
+    line = LOW;
+
+  return line;
+}
+
+//leaves the current phase for the next one
+void PC1550Sim::enterPhase(int next){
+  int bit = phase / 2;
+
+  //the panel samples the keypad bit just before clocking its next bit
+  if (phase >= 0 && (phase & 1) == 1 && bit < 7){
+    keypad_rx |= (uint8_t)(!dataLine()) << (6 - bit);
+    if (keypad_cycles > 0)
+      keypad_presented = true;
+  }
+
+  //the end of a transmission cycle
+  if (phase == 31){
+    frames++;
+
+    //a new key is accepted only after a cycle without one
+    bool accepted = false;
+    if (keypad_rx != 0 && last_keypad_rx == 0 && received_len < sizeof(received) - 1){
+      received[received_len++] = keyChar(keypad_rx);
+      received[received_len] = '\0';
+      accepted = true;
+    }
+    last_keypad_rx = keypad_rx;
+    keypad_rx = 0;
+    if (keypad_presented)
+      keypad_cycles--;
+    keypad_presented = false;
+
+    beep_ack = accepted;
+    next = -1;
+  }
+
+  //each cycle carries the latest data, plus a beep for a new key
+  if (phase < 0){
+    frame_controller = next_controller | (beep_ack ? 0x0001 : 0);
+    frame_pc16out = next_pc16out;
+  }
+
+  bool clockBefore = phase >= 0 && (phase & 1) == 0;
+  phase = next;
+  if (phase < 0)
+    phase_end = now + jitter(syncGapUs);
+  else
+    phase_end = now + jitter(bitPeriodUs / 2);
+  bool clockAfter = phase >= 0 && (phase & 1) == 0;
+
+  if (clockBefore != clockAfter){
+    wakeups++;
+    raiseInterrupt(clockpin);
+  }
+}
+
+void PC1550Sim::advance(unsigned long us){
+  unsigned long target = now + us;
+  while (true){
+    //timer ticks (see PC1550StartTimer()) in order with the bus, the bus
+    //first when they coincide
+    if (timerDue(target) && (long)(nextTimerTick() - phase_end) < 0){
+      now = nextTimerTick();
+      wakeups++;
+      runTimer();
+    }
+    else if (phase_end <= target){
+      now = phase_end;
+      enterPhase(phase + 1);
+    }
+    else
+      break;
+  }
+
+  //a handler that waited may already have taken time past the target
+  if ((long)(target - now) > 0)
+    now = target;
+}
+
+const char *PC1550Sim::keysReceived(){
+  return received;
+}
+
+void PC1550Sim::clearKeysReceived(){
+  received_len = 0;
+  received[0] = '\0';
+}
+
+uint8_t PC1550Sim::lastKeypadData(){
+  return last_keypad_rx;
+}
+
+unsigned long PC1550Sim::framesSent(){
+  return frames;
+}
+
+bool PC1550Sim::inSyncGap(){
+  return phase < 0;
+}
+
+bool PC1550Sim::ownsPin(uint8_t pin){
+  return pin == datapin || pin == clockpin || pin == pgmpin;
+}
+
+int PC1550Sim::digitalRead(uint8_t pin){
+  if (pin == clockpin)
+    return glitch((phase >= 0 && (phase & 1) == 0) ? HIGH : LOW);
+  if (pin == datapin)
+    return glitch(dataLine());
+  if (pin == pgmpin && phase >= 0 && (phase & 1) == 0)
+    return glitch((frame_pc16out >> (15 - phase / 2)) & 1);
+  if (pin == pgmpin)
+    return glitch(LOW);
+  return LOW;
+}
+
+void PC1550Sim::pinMode(uint8_t pin, uint8_t mode){
+  if (pin == datapin)
+    data_mode = mode;
+}
+
+void PC1550Sim::digitalWrite(uint8_t pin, uint8_t value){
+  if (pin == datapin)
+    data_level = value;
+}
+
+unsigned long PC1550Sim::micros(){
+  return now;
+}
+
+void PC1550Sim::delayMicroseconds(unsigned int us){
+  advance(us);
+}
+
+void PC1550Sim::sleepUntilInterrupt(){
+  unsigned long before = wakeups;
+  while (wakeups == before){
+    unsigned long until = phase_end;
+    if (timerDue(nextTimerTick()) && (long)(nextTimerTick() - until) < 0)
+      until = nextTimerTick();
+    advance(until - now);
+  }
+}
+
+/* ==================================================================== */
+/*                         S I M U L A T O R    G R O U P               */
+/* ==================================================================== */
+
+PC1550SimGroup::PC1550SimGroup(){
+  count = 0;
+}
+
+bool PC1550SimGroup::add(PC1550Sim &sim){
+  if (count == PC1550_SIM_GROUP_SIZE)
+    return false;
+  sims[count++] = &sim;
+  return true;
+}
+
+PC1550Sim *PC1550SimGroup::owner(uint8_t pin){
+  for (uint8_t i = 0; i < count; i++)
+    if (sims[i]->ownsPin(pin))
+      return sims[i];
+  return 0;
+}
+
+void PC1550SimGroup::advance(unsigned long us){
+  for (uint8_t i = 0; i < count; i++)
+    sims[i]->advance(us);
+}
+
+int PC1550SimGroup::digitalRead(uint8_t pin){
+  PC1550Sim *sim = owner(pin);
+  return sim != 0 ? sim->digitalRead(pin) : LOW;
+}
+
+void PC1550SimGroup::pinMode(uint8_t pin, uint8_t mode){
+  PC1550Sim *sim = owner(pin);
+  if (sim != 0)
+    sim->pinMode(pin, mode);
+}
+
+void PC1550SimGroup::digitalWrite(uint8_t pin, uint8_t value){
+  PC1550Sim *sim = owner(pin);
+  if (sim != 0)
+    sim->digitalWrite(pin, value);
+}
+
+unsigned long PC1550SimGroup::micros(){
+  return count > 0 ? sims[0]->micros() : 0;
+}
+
+void PC1550SimGroup::delayMicroseconds(unsigned int us){
+  advance(us);
+}
@@ -0,0 +1,162 @@
+#ifndef DSC_PC1550_SIM_H
+#define DSC_PC1550_SIM_H
+
+/*
+ * A simulated PC1550 control panel for running the library on a host.
+ *
+ * PC1550Sim is a PC1550Backend: install it with PC1550SetBackend() before
+ * constructing a PC1550 and the library's pin reads, pin modes and clock
+ * all come from the simulation.  Time only moves when advance() (or the
+ * library's own delayMicroseconds()) is called, so a decoder can be driven
+ * at any polling interval, many times faster than real time.
+ *
+ * The bus is modelled as the wired-AND line it is: the data line reads LOW
+ * whenever the panel, a keypad or the emulator pulls it low.
+ *
+ *   - the panel idles the clock for syncGapUs, then clocks out 16 bits
+ *     bitPeriodUs apart.  The clock pin reads HIGH while the panel presents
+ *     a bit (data = controller bit, PGM = PC16-OUT bit, most significant
+ *     first) and LOW for the second half of the period.
+ *   - during the LOW half of the first 7 bits the panel releases the data
+ *     line and samples whatever keypads drive just before the next bit.
+ *   - the emulator holds the data line from the bit after which it sends
+ *     a key bit until it next polls past the following bit, so a one bit
+ *     also masks the controller bit clocked right after it.
+ *   - a key the panel reads (after a cycle with no key) is recorded in
+ *     keysReceived() and acknowledged with a one frame beep.
+ *   - with glitchOneIn set, about one read of a line in that many returns
+ *     the wrong level, as noise picked up on long wiring would.
+ */
+
+#include "PC1550.h"
+
+class PC1550Sim : public PC1550Backend {
+
+  uint8_t datapin;
+  uint8_t clockpin;
+  uint8_t pgmpin;
+
+  //simulated time
+  unsigned long now;
+
+  //the current phase of the transmission cycle: -1 is the sync gap,
+  //2k is the clock HIGH half of bit k and 2k+1 its LOW half
+  int phase;
+  unsigned long phase_end;
+
+  //the words being clocked out this cycle and those queued for the next
+  uint16_t frame_controller;
+  uint16_t frame_pc16out;
+  uint16_t next_controller;
+  uint16_t next_pc16out;
+
+  //the keypad bits the panel has sampled this cycle and last cycle
+  uint8_t keypad_rx;
+  uint8_t last_keypad_rx;
+
+  //set when the panel accepted a key and owes a beep next cycle
+  bool beep_ack;
+
+  //a physical keypad on the bus, how many more cycles it holds its key,
+  //and whether the key reached the bus during this cycle
+  uint8_t keypad_key;
+  uint8_t keypad_cycles;
+  bool keypad_presented;
+
+  //the emulator's data pin
+  uint8_t data_mode;
+  uint8_t data_level;
+
+  //keys the panel accepted
+  char received[65];
+  uint8_t received_len;
+
+  unsigned long frames;
+  uint32_t seed;
+
+  //interrupts raised and timer ticks run, see sleepUntilInterrupt()
+  unsigned long wakeups;
+  uint32_t glitch_seed;
+
+  unsigned long jitter(unsigned long duration);
+  int glitch(int level);
+  void enterPhase(int next);
+  bool dataLine();
+
+ public:
+  PC1550Sim(uint8_t datapin = A3, uint8_t clockpin = A4, uint8_t pgmpin = A1);
+
+  //panel timing, which may be changed at any time
+  unsigned long syncGapUs;
+  unsigned long bitPeriodUs;
+  unsigned long jitterUs;
+
+  //noise on the lines as read by the emulator, 0 for none
+  unsigned long glitchOneIn;
+
+  //what the panel sends from the next transmission cycle on.  The
+  //controller word is the zone byte followed by the state byte
+  void setControllerData(uint16_t word);
+  void setPC16OutData(uint16_t word);
+
+  //holds a key down on a physical keypad for a number of cycles
+  bool pressKey(char key, uint8_t cycles = 1);
+
+  //moves simulated time forward, raising interrupts on clock changes and
+  //running the timer interrupt, if one is started, on each tick
+  void advance(unsigned long us);
+
+  //the keys accepted by the panel so far, oldest first
+  const char *keysReceived();
+  void clearKeysReceived();
+
+  //the keypad byte the panel read during the last complete cycle
+  uint8_t lastKeypadData();
+
+  //complete transmission cycles clocked out so far
+  unsigned long framesSent();
+
+  //true while the clock is LOW in the long gap between cycles
+  bool inSyncGap();
+
+  //true if pin is one of this panel's lines
+  bool ownsPin(uint8_t pin);
+
+  //PC1550Backend
+  int digitalRead(uint8_t pin);
+  void pinMode(uint8_t pin, uint8_t mode);
+  void digitalWrite(uint8_t pin, uint8_t value);
+  unsigned long micros();
+  void delayMicroseconds(unsigned int us);
+
+  //skips ahead to the next clock change or timer tick, whichever comes
+  //first, and runs its interrupt
+  void sleepUntilInterrupt();
+};
+
+//Several simulated panels on their own pins, advanced together.  Install
+//the group as the backend instead of the panels themselves
+#define PC1550_SIM_GROUP_SIZE 8
+
+class PC1550SimGroup : public PC1550Backend {
+
+  PC1550Sim *sims[PC1550_SIM_GROUP_SIZE];
+  uint8_t count;
+
+  PC1550Sim *owner(uint8_t pin);
+
+ public:
+  PC1550SimGroup();
+
+  bool add(PC1550Sim &sim);
+  void advance(unsigned long us);
+
+  //PC1550Backend
+  int digitalRead(uint8_t pin);
+  void pinMode(uint8_t pin, uint8_t mode);
+  void digitalWrite(uint8_t pin, uint8_t value);
+  unsigned long micros();
+  void delayMicroseconds(unsigned int us);
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "PC1550Thread.h"
+
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+PC1550Thread::PC1550Thread(PC1550 &panel)
+  : running(false), keys_posted(false), keys_refused(0) {
+  this->panel = &panel;
+  started = false;
+  real_time = false;
+  poll_us = PC1550_THREAD_POLL_US;
+  keys[0] = '\0';
+  key_hold = 1;
+}
+
+PC1550Thread::~PC1550Thread(){
+  stop();
+}
+
+//thread attributes pinned to cpu, unless it is -1
+static void initAttr(pthread_attr_t *attr, int cpu){
+  pthread_attr_init(attr);
+  if (cpu >= 0){
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+  }
+}
+
+bool PC1550Thread::start(int cpu, int priority, unsigned long pollUs){
+  if (started)
+    return false;
+  poll_us = pollUs;
+
+  //ask for the real-time attributes up front; without the privilege for
+  //them, fall back to an ordinary thread
+  pthread_attr_t attr, rt_attr;
+  initAttr(&attr, cpu);
+  initAttr(&rt_attr, cpu);
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  pthread_attr_setinheritsched(&rt_attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&rt_attr, SCHED_FIFO);
+  pthread_attr_setschedparam(&rt_attr, &param);
+
+  running = true;
+  real_time = pthread_create(&thread, &rt_attr, run, this) == 0;
+  bool created = real_time || pthread_create(&thread, &attr, run, this) == 0;
+  pthread_attr_destroy(&rt_attr);
+  pthread_attr_destroy(&attr);
+  if (!created){
+    running = false;
+    return false;
+  }
+  started = true;
+  return true;
+}
+
+void PC1550Thread::stop(){
+  if (!started)
+    return;
+  running = false;
+  pthread_join(thread, 0);
+  started = false;
+}
+
+bool PC1550Thread::realTime(){
+  return real_time;
+}
+
+bool PC1550Thread::read(PC1550ThreadState &copy){
+  if (state.writes() == 0)
+    return false;
+  state.read(copy);
+  return true;
+}
+
+uint32_t PC1550Thread::framesPublished(){
+  return state.writes();
+}
+
+uint32_t PC1550Thread::keysRefused(){
+  return keys_refused.load(std::memory_order_relaxed);
+}
+
+bool PC1550Thread::sendKeys(const char *keys, uint8_t holdCycles){
+  size_t length = strlen(keys);
+  if (keys_posted.load(std::memory_order_acquire) || length == 0 ||
+      length >= sizeof(this->keys) || holdCycles == 0)
+    return false;
+  strcpy(this->keys, keys);
+  key_hold = holdCycles;
+  keys_posted.store(true, std::memory_order_release);
+  return true;
+}
+
+void *PC1550Thread::run(void *self){
+  ((PC1550Thread *)self)->loop();
+  return 0;
+}
+
+//polls on an absolute schedule, so the time spent decoding doesn't add
+//to the interval.  After an overrun (a frame published, the thread
+//preempted) the schedule restarts from now rather than racing to catch up
+void PC1550Thread::loop(){
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while (running.load(std::memory_order_relaxed)){
+    panel->processClockCycle();
+
+    if (panel->atTransmissionEnd()){
+      PC1550ThreadState published;
+      published.snapshot = panel->snapshot();
+      published.diagnostics = panel->readDiagnostics();
+      state.write(published);
+    }
+
+    //keys wait in the panel's own queue until it will take them.  One
+    //refused while there was room never will be, so it is dropped
+    if (keys_posted.load(std::memory_order_acquire)){
+      bool room = strlen(keys) <= PC1550_KEY_QUEUE_SIZE - 1U - panel->keysQueued();
+      if (panel->sendKeys(keys, key_hold) != 0)
+        keys_posted.store(false, std::memory_order_release);
+      else if (room){
+        keys_refused.fetch_add(1, std::memory_order_relaxed);
+        keys_posted.store(false, std::memory_order_release);
+      }
+    }
+
+    next.tv_nsec += poll_us * 1000;
+    while (next.tv_nsec >= 1000000000L){
+      next.tv_nsec -= 1000000000L;
+      next.tv_sec++;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > next.tv_sec ||
+        (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+      next = now;
+    else
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, 0);
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef DSC_PC1550_THREAD_H
+#define DSC_PC1550_THREAD_H
+
+/*
+ * Runs a PC1550 on a dedicated real-time thread of a Linux host.
+ *
+ * The thread calls processClockCycle() every pollUs on an absolute
+ * schedule, pinned to one CPU and at SCHED_FIFO priority when the process
+ * is allowed (root or CAP_SYS_NICE; otherwise it runs as an ordinary
+ * thread and realTime() says so).  Every frame it decodes is published as
+ * a PC1550ThreadState through a PC1550SeqLock, so any number of other
+ * threads can read() the latest one without ever blocking the decoder:
+ *
+ *     PC1550RealTimeSim backend(sim);   // or a PC1550LinuxGpio
+ *     PC1550SetBackend(&backend);
+ *     PC1550 panel;
+ *     PC1550Thread decoder(panel);
+ *     decoder.start(3);                 // on CPU 3
+ *     ...
+ *     PC1550ThreadState state;
+ *     if (decoder.read(state) && state.snapshot.controllerChanged) ...
+ *
+ * Once started, the panel (and its backend) belong to the thread: use
+ * sendKeys() here rather than the panel's own.
+ */
+
+#include <pthread.h>
+#include <atomic>
+
+#include "PC1550.h"
+#include "PC1550SeqLock.h"
+
+//how often the thread polls the bus, and its SCHED_FIFO priority
+#ifndef PC1550_THREAD_POLL_US
+#define PC1550_THREAD_POLL_US 100
+#endif
+#ifndef PC1550_THREAD_PRIORITY
+#define PC1550_THREAD_PRIORITY 80
+#endif
+
+//everything published after a frame
+struct PC1550ThreadState {
+  PC1550::Snapshot snapshot;
+  PC1550::Diagnostics diagnostics;
+};
+
+class PC1550Thread {
+
+  PC1550 *panel;
+  pthread_t thread;
+  std::atomic<bool> running;
+  bool started;
+  bool real_time;
+  unsigned long poll_us;
+
+  PC1550SeqLock<PC1550ThreadState> state;
+
+  //a key sequence handed over by sendKeys(), waiting for the thread, and
+  //the number the panel refused for something other than a full queue
+  char keys[PC1550_KEY_QUEUE_SIZE];
+  uint8_t key_hold;
+  std::atomic<bool> keys_posted;
+  std::atomic<uint32_t> keys_refused;
+
+  static void *run(void *self);
+  void loop();
+
+ public:
+  PC1550Thread(PC1550 &panel);
+  ~PC1550Thread();
+
+  //starts decoding on cpu (-1 for any).  Returns false if the thread
+  //couldn't be created
+  bool start(int cpu = -1, int priority = PC1550_THREAD_PRIORITY,
+             unsigned long pollUs = PC1550_THREAD_POLL_US);
+  void stop();
+
+  //true if the thread got its SCHED_FIFO priority
+  bool realTime();
+
+  //copies the state published with the latest frame.  Returns false
+  //until there is one
+  bool read(PC1550ThreadState &state);
+  uint32_t framesPublished();
+
+  //queues keys as PC1550::sendKeys() does, from any one thread.  Returns
+  //false for an empty sequence, a hold of 0, one too long for the queue,
+  //or while the previous sequence hasn't been picked up yet
+  bool sendKeys(const char *keys, uint8_t holdCycles = 1);
+
+  //sequences accepted here that the panel then refused (a character that
+  //isn't a key) and dropped
+  uint32_t keysRefused();
+};
+
+#endif
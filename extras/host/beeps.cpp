@@ -0,0 +1,172 @@
+/*
+ * Plays the panel's beep patterns through the simulated bus and names them.
+ *
+ *   ./beeps [poll_us]
+ *
+ * The simulated panel sounds a key acknowledgement, an error tone, a six
+ * beep confirmation, a trouble double beep, an exit delay of eight beeps a
+ * second, a five second entry delay tone, and then error tones straight
+ * after a single beep and after a double beep, one after another.  The
+ * decoder is polled every poll_us (200 by default) and every frame goes
+ * through PC1550Beeps.  Prints each pattern event with when it came, in
+ * frames after the pattern could first have been told apart.  The exit
+ * status is non-zero if the events differ from the patterns played, a
+ * duration is off by more than two frames, or an event comes more than
+ * three frames late.  A second PC1550Beeps sees the same frames but is
+ * never read, and must count every event it had no room for as dropped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "PC1550.h"
+#include "PC1550Beeps.h"
+#include "PC1550Sim.h"
+
+struct Tone {
+  bool on;
+  unsigned long ms;
+};
+
+//what the keypad sounds, from the start
+static const Tone script[] = {
+  {false, 1000},
+  {true, 100}, {false, 1000},                         //ack
+  {true, 2000}, {false, 1000},                        //error
+  {true, 100}, {false, 100}, {true, 100}, {false, 100},
+  {true, 100}, {false, 100}, {true, 100}, {false, 100},
+  {true, 100}, {false, 100}, {true, 100}, {false, 1100}, //confirm
+  {true, 100}, {false, 150}, {true, 100}, {false, 2000}, //trouble
+  {true, 100}, {false, 900}, {true, 100}, {false, 900},
+  {true, 100}, {false, 900}, {true, 100}, {false, 900},
+  {true, 100}, {false, 900}, {true, 100}, {false, 900},
+  {true, 100}, {false, 900}, {true, 100}, {false, 2900}, //exit delay
+  {true, 5000}, {false, 1000},                        //entry delay
+  {true, 100}, {false, 150}, {true, 1500}, {false, 1000}, //ack, error
+  {true, 100}, {false, 100}, {true, 100}, {false, 150},
+  {true, 2000}, {false, 1000},                        //trouble, error
+};
+
+//the events that should come of it, and the time (ms from the start)
+//each could first have been told apart
+struct Expected {
+  uint8_t pattern;
+  bool ongoing;
+  uint8_t beeps;
+  unsigned long durationMs;
+  unsigned long decidedMs;
+};
+
+static const Expected expected[] = {
+  {PC1550Beeps::ACK, false, 1, 100, 1350},
+  {PC1550Beeps::ERROR, false, 1, 2000, 4100},
+  {PC1550Beeps::CONFIRM, true, 3, 500, 5600},
+  {PC1550Beeps::CONFIRM, false, 6, 1100, 6450},
+  {PC1550Beeps::TROUBLE, false, 2, 350, 7900},
+  {PC1550Beeps::ACK, false, 1, 100, 10000},
+  {PC1550Beeps::ACK, false, 1, 100, 11000},
+  {PC1550Beeps::EXIT_DELAY, true, 3, 2100, 12000},
+  {PC1550Beeps::EXIT_DELAY, false, 8, 7100, 17800},
+  {PC1550Beeps::ENTRY_DELAY, true, 1, 3000, 22700},
+  {PC1550Beeps::ENTRY_DELAY, false, 1, 5000, 24700},
+  {PC1550Beeps::ACK, false, 1, 100, 26900},
+  {PC1550Beeps::ERROR, false, 1, 1500, 27400},
+  {PC1550Beeps::TROUBLE, false, 2, 300, 29850},
+  {PC1550Beeps::ERROR, false, 1, 2000, 30850},
+};
+
+static bool beepingAt(unsigned long ms){
+  unsigned long end = 0;
+  for (size_t i = 0; i < sizeof(script) / sizeof(script[0]); i++){
+    end += script[i].ms;
+    if (ms < end)
+      return script[i].on;
+  }
+  return false;
+}
+
+static unsigned long scriptMs(){
+  unsigned long total = 0;
+  for (size_t i = 0; i < sizeof(script) / sizeof(script[0]); i++)
+    total += script[i].ms;
+  return total;
+}
+
+static unsigned long distance(unsigned long a, unsigned long b){
+  return a > b ? a - b : b - a;
+}
+
+int main(int argc, char **argv){
+  unsigned long poll = argc > 1 ? strtoul(argv[1], 0, 10) : 200;
+
+  PC1550Sim sim;
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+  PC1550Beeps beeps;
+  PC1550Beeps unread;
+
+  //let the decoder find the bus first
+  while (panel.snapshot().sequence < 3){
+    sim.advance(poll);
+    panel.processClockCycle();
+  }
+
+  unsigned long frameMs = (PC1550_SYNC_GAP_US + 16UL * PC1550_BIT_PERIOD_US) / 1000;
+  unsigned long start = micros();
+  unsigned long frames = sim.framesSent();
+  size_t seen = 0;
+  bool ok = true;
+  PC1550BeepEvent event;
+
+  while ((micros() - start) / 1000 < scriptMs() + 1000){
+    sim.advance(poll);
+    panel.processClockCycle();
+
+    //the panel sends what the keypad is doing from the next frame on
+    if (sim.framesSent() != frames){
+      frames = sim.framesSent();
+      sim.setControllerData(beepingAt((micros() - start) / 1000) ? PC1550::BEEPING : 0);
+    }
+
+    beeps.update(panel);
+    unread.update(panel);
+    while (beeps.read(event)){
+      unsigned long at = (event.time - start) / 1000;
+      printf("%6lu ms  %-12s %-8s %3u beeps %5lu ms", at,
+             PC1550Beeps::patternName(event.pattern),
+             event.ongoing ? "ongoing" : "", event.beeps, event.durationMs);
+
+      if (seen >= sizeof(expected) / sizeof(expected[0])){
+        printf("  unexpected\n");
+        ok = false;
+        continue;
+      }
+      const Expected &e = expected[seen++];
+      long late = ((long)at - (long)e.decidedMs) / (long)frameMs;
+      printf("  %+ld frames\n", late);
+      if (event.pattern != e.pattern || event.ongoing != e.ongoing ||
+          event.beeps != e.beeps ||
+          distance(event.durationMs, e.durationMs) > 2 * frameMs ||
+          at + frameMs < e.decidedMs || at > e.decidedMs + 3 * frameMs){
+        printf("          expected %s%s, %u beeps, %lu ms at %lu ms\n",
+               PC1550Beeps::patternName(e.pattern), e.ongoing ? " ongoing" : "",
+               e.beeps, e.durationMs, e.decidedMs);
+        ok = false;
+      }
+    }
+  }
+
+  if (seen != sizeof(expected) / sizeof(expected[0])){
+    printf("%lu of %lu patterns heard\n", (unsigned long)seen,
+           (unsigned long)(sizeof(expected) / sizeof(expected[0])));
+    ok = false;
+  }
+
+  //the ring keeps one slot free
+  unsigned long kept = PC1550_BEEP_EVENTS - 1;
+  unsigned long dropped = seen > kept ? seen - kept : 0;
+  printf("unread             %u of %lu events dropped\n",
+         unread.eventsDropped(), (unsigned long)seen);
+  ok = ok && unread.eventsDropped() == dropped;
+  return ok ? 0 : 1;
+}
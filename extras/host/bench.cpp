@@ -0,0 +1,493 @@
+/*
+ * Decoder latency, jitter and polling budget benchmark.
+ *
+ *   ./bench [seconds] [jitter_us]
+ *
+ * Drives processClockCycle() from the simulated panel and times every call,
+ * sorting the calls by the path they took through the decoder:
+ *
+ *   idle        no clock change
+ *   controller  the clock rose: a controller bit is read
+ *   keypad      the clock fell: a keypad bit is scheduled
+ *   frame end   the 16th bit completed a frame and it was published
+ *
+ * and prints a latency histogram per path plus the decoder's throughput in
+ * frames per second of CPU time.  It then sweeps the polling interval to
+ * find the longest one that still decodes every frame and every key, with
+ * the panel's bit timing spread by jitter_us (50 by default), with and
+ * without the glitch filter.  It counts the valid frames decoded from a
+ * noisy bus with the filter off and on, and how long the decoder takes to
+ * deliver its first frame after starting, or its next one after a stall,
+ * at random points in the panel's cycle, and sends keys across stalls
+ * mid-frame and across the gap between transmissions.  Finally it times
+ * PC1550Scanner::scan() with one to four buses, next to polling the same
+ * buses one processClockCycle() at a time.
+ *
+ * The exit status is non-zero if the 50us run lost a frame or a key, if
+ * polling at PC1550_TIMER_SAMPLE_US lost anything, if the glitch filter
+ * let a wrong frame through, or if a stall made the panel receive (or the
+ * decoder see) any key but the one sent, or made the panel receive a
+ * different number of keys than the decoder confirmed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "PC1550.h"
+#include "PC1550Scanner.h"
+#include "PC1550Sim.h"
+
+enum { IDLE, CONTROLLER, KEYPAD, FRAME_END, PATHS };
+static const char *pathNames[PATHS] = { "idle", "controller", "keypad", "frame end" };
+
+//latency histogram with power of two buckets in nanoseconds
+#define BUCKETS 24
+struct Histogram {
+  unsigned long counts[BUCKETS];
+  unsigned long calls;
+  double total;
+  double min;
+  double max;
+};
+
+static double nowNs(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void add(Histogram &h, double ns){
+  int bucket = 0;
+  while (bucket < BUCKETS - 1 && ns >= (double)(2UL << bucket))
+    bucket++;
+  h.counts[bucket]++;
+  if (h.calls == 0 || ns < h.min) h.min = ns;
+  if (h.calls == 0 || ns > h.max) h.max = ns;
+  h.calls++;
+  h.total += ns;
+}
+
+//the latency below which a fraction of calls fall, to bucket resolution
+static unsigned long percentile(const Histogram &h, double fraction){
+  unsigned long seen = 0;
+  for (int b = 0; b < BUCKETS; b++){
+    seen += h.counts[b];
+    if (seen >= fraction * h.calls)
+      return 2UL << b;
+  }
+  return 2UL << (BUCKETS - 1);
+}
+
+static void print(const char *name, const Histogram &h){
+  if (h.calls == 0)
+    return;
+  printf("\n%-10s %9lu calls  min %5.0f  mean %6.1f  p50 <%-5lu p99 <%-5lu max %7.0f ns\n",
+         name, h.calls, h.min, h.total / h.calls, percentile(h, 0.5),
+         percentile(h, 0.99), h.max);
+  for (int b = 0; b < BUCKETS; b++){
+    if (h.counts[b] == 0)
+      continue;
+    int bar = (int)(50.0 * h.counts[b] / h.calls + 0.5);
+    printf("  <%6lu ns %9lu ", 2UL << b, h.counts[b]);
+    for (int i = 0; i < bar; i++)
+      putchar('#');
+    putchar('\n');
+  }
+}
+
+//polls on after a run, without pressing anything, until a key pressed
+//at its very end has had its frames and the panel is back in the gap,
+//so that every frame sent and every key pressed can be counted
+static void drain(PC1550Sim &sim, PC1550 &panel, unsigned long poll,
+                  unsigned long &frames, unsigned long &keysSeen){
+  unsigned long end = sim.micros() + 200000;
+  unsigned long gap = 0;
+  while (sim.micros() < end || gap < 5000){
+    sim.advance(poll);
+    panel.processClockCycle();
+    gap = sim.inSyncGap() ? gap + poll : 0;
+    if (!panel.atTransmissionEnd())
+      continue;
+    frames++;
+    if (panel.keyPressed() == '5')
+      keysSeen++;
+  }
+}
+
+//runs a decoder against a fresh panel, returning true if every frame and
+//every key made it through
+static bool lossless(unsigned long poll, unsigned long jitter, double seconds,
+                     bool filtered){
+  PC1550Sim sim;
+  sim.jitterUs = jitter;
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+  if (filtered)
+    panel.enableGlitchFilter();
+  sim.setControllerData(0b1010000010000000);
+
+  unsigned long frames = 0;
+  unsigned long end = (unsigned long)(seconds * 1e6);
+  unsigned long keysPressed = 0, keysSeen = 0;
+  while (sim.micros() < end){
+    sim.advance(poll);
+    panel.processClockCycle();
+    if (!panel.atTransmissionEnd())
+      continue;
+    frames++;
+    if (panel.keyPressed() == '5')
+      keysSeen++;
+    if (frames % 20 == 0){
+      sim.pressKey('5', 1);
+      keysPressed++;
+    }
+  }
+  drain(sim, panel, poll, frames, keysSeen);
+  return frames == sim.framesSent() && keysSeen == keysPressed;
+}
+
+//decodes a bus on which one read in glitchOneIn is wrong, counting the
+//frames that came through intact and the state changes that were noise
+struct Noise {
+  unsigned long frames;
+  unsigned long valid;
+  unsigned long falseChanges;
+  PC1550::Diagnostics diag;
+  double nsPerPoll;
+};
+
+static Noise noisy(unsigned long glitchOneIn, bool filtered, double seconds){
+  PC1550Sim sim;
+  sim.glitchOneIn = glitchOneIn;
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+  if (filtered)
+    panel.enableGlitchFilter();
+  const uint16_t controller = 0b1010000010000000;
+  const uint16_t pc16out = 0b0000000000110000;
+  sim.setControllerData(controller);
+  sim.setPC16OutData(pc16out);
+
+  Noise noise;
+  memset(&noise, 0, sizeof(noise));
+  double total = 0;
+  unsigned long polls = 0;
+  unsigned long end = (unsigned long)(seconds * 1e6);
+  while (sim.micros() < end){
+    sim.advance(200);
+    double start = nowNs();
+    panel.processClockCycle();
+    total += nowNs() - start;
+    polls++;
+    if (!panel.atTransmissionEnd())
+      continue;
+    noise.frames++;
+    PC1550::Snapshot snap = panel.snapshot();
+    if (snap.controller == controller && snap.pc16out == pc16out &&
+        snap.keypad == 0)
+      noise.valid++;
+    if (noise.frames > 1 && panel.keypadStateChanged())
+      noise.falseChanges++;
+  }
+  noise.diag = panel.readDiagnostics();
+  noise.nsPerPoll = total / polls;
+  return noise;
+}
+
+//starts a decoder at a random point in the panel's cycle, optionally
+//stalls the sketch for stallUs in the middle of a later frame, and
+//returns the time from the start (or from the end of the stall) to the
+//next frame published.  A key sent just before the stall has to reach
+//the panel as itself or not at all: other keys it received are counted in
+//wrongKeys
+static unsigned long firstFrame(uint32_t &seed, unsigned long stallUs,
+                                unsigned long &wrongKeys){
+  PC1550Sim sim;
+  PC1550SetBackend(&sim);
+  seed = seed * 1103515245 + 12345;
+  sim.advance((seed >> 8) % 60000);
+  PC1550 panel;
+
+  if (stallUs > 0){
+    unsigned long frames = 0;
+    while (frames < 3){
+      sim.advance(200);
+      panel.processClockCycle();
+      if (panel.atTransmissionEnd())
+        frames++;
+    }
+    while (sim.inSyncGap())
+      sim.advance(200);
+    seed = seed * 1103515245 + 12345;
+    sim.advance(2000 + (seed >> 8) % 15000);
+    panel.processClockCycle();
+    panel.sendKey('1');
+    sim.advance(stallUs);
+  }
+
+  unsigned long start = sim.micros();
+  do{
+    sim.advance(200);
+    panel.processClockCycle();
+  }
+  while (!panel.atTransmissionEnd());
+  unsigned long took = sim.micros() - start;
+
+  //give the key time to go out, or be retried
+  for (int i = 0; i < 2000; i++){
+    sim.advance(200);
+    panel.processClockCycle();
+  }
+  for (const char *k = sim.keysReceived(); *k; k++)
+    if (*k != '1')
+      wrongKeys++;
+  return took;
+}
+
+//sends a key at the end of a frame and then stalls the sketch past the
+//sync gap and into the next frame, over and over, polling the bus itself
+//or through a scanner.  Returns the keys the panel received, the ones the
+//decoder confirmed it sent, and the keys the panel received or the
+//decoder saw that weren't the one sent
+struct StallKeys {
+  unsigned long stalls;
+  unsigned long received;
+  unsigned long confirmed;
+  unsigned long wrong;
+};
+
+//moves the keys the panel has received into the counts, clearing them so
+//a long run never fills the simulator's buffer
+static void tallyKeys(PC1550Sim &sim, StallKeys &result){
+  for (const char *k = sim.keysReceived(); *k; k++){
+    if (*k == '1')
+      result.received++;
+    else
+      result.wrong++;
+  }
+  sim.clearKeysReceived();
+}
+
+static StallKeys stallKeys(uint32_t &seed, unsigned long runs, bool scanned){
+  PC1550Sim sim;
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+  PC1550Scanner scanner;
+  if (scanned)
+    scanner.addBus(panel);
+  StallKeys result;
+  memset(&result, 0, sizeof(result));
+
+  while (result.stalls < runs){
+    sim.advance(100);
+    if (scanned)
+      scanner.scan();
+    else
+      panel.processClockCycle();
+    char key = panel.keyPressed();
+    if (panel.atTransmissionEnd() && key != '\0' && key != '1')
+      result.wrong++;
+    if (!panel.atTransmissionEnd())
+      continue;
+    tallyKeys(sim, result);
+    if (!panel.sendKey('1'))
+      continue;
+
+    //the gap is about 26.5ms, so this wakes up somewhere in the first
+    //half of the next frame
+    seed = seed * 1103515245 + 12345;
+    sim.advance(27000 + (seed >> 8) % 12000);
+    result.stalls++;
+  }
+
+  //let the last key go out
+  for (int i = 0; i < 2000; i++){
+    sim.advance(100);
+    if (scanned)
+      scanner.scan();
+    else
+      panel.processClockCycle();
+  }
+  tallyKeys(sim, result);
+  result.confirmed = panel.readDiagnostics().keysConfirmed;
+  return result;
+}
+
+//mean ns per sample of every bus, scanned together or polled one by one
+static double multiBus(uint8_t buses, bool scanned, double seconds){
+  static const uint8_t pins[4][3] = {
+    { A3, A4, A1 }, { 2, 3, 4 }, { 5, 6, 7 }, { 8, 9, 10 }
+  };
+  PC1550Sim *sims[4];
+  PC1550 *panels[4];
+  PC1550SimGroup group;
+  PC1550SetBackend(&group);
+  PC1550Scanner scanner;
+  for (uint8_t i = 0; i < buses; i++){
+    sims[i] = new PC1550Sim(pins[i][0], pins[i][1], pins[i][2]);
+    sims[i]->syncGapUs += i * 300;
+    group.add(*sims[i]);
+    panels[i] = new PC1550(pins[i][0], pins[i][1], pins[i][2]);
+    scanner.addBus(*panels[i]);
+  }
+
+  double total = 0;
+  unsigned long samples = 0;
+  unsigned long end = (unsigned long)(seconds * 1e6);
+  while (group.micros() < end){
+    group.advance(50);
+    double start = nowNs();
+    if (scanned)
+      scanner.scan();
+    else
+      for (uint8_t i = 0; i < buses; i++)
+        panels[i]->processClockCycle();
+    total += nowNs() - start;
+    samples++;
+  }
+
+  for (uint8_t i = 0; i < buses; i++){
+    delete panels[i];
+    delete sims[i];
+  }
+  return total / samples;
+}
+
+int main(int argc, char **argv){
+  double seconds = argc > 1 ? atof(argv[1]) : 60;
+  unsigned long jitter = argc > 2 ? strtoul(argv[2], 0, 10) : 50;
+
+  //the cost of taking the time itself
+  double overhead = 1e9;
+  for (int i = 0; i < 10000; i++){
+    double a = nowNs();
+    double b = nowNs();
+    if (b - a < overhead)
+      overhead = b - a;
+  }
+
+  PC1550Sim sim;
+  sim.jitterUs = jitter;
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+  sim.setControllerData(0b1010000010000000);
+  sim.setPC16OutData(0b0000000000110000);
+
+  Histogram paths[PATHS];
+  memset(paths, 0, sizeof(paths));
+
+  //poll every 50us, pressing a key every second so the keypad path and
+  //the key bookkeeping at the end of the frame are exercised
+  bool lastClock = sim.digitalRead(A4);
+  unsigned long frames = 0, keysPressed = 0, keysSeen = 0;
+  double decodeNs = 0;
+  unsigned long end = (unsigned long)(seconds * 1e6);
+  while (sim.micros() < end){
+    sim.advance(50);
+    if (sim.micros() % 1000000 < 50){
+      sim.pressKey('5', 2);
+      keysPressed++;
+    }
+
+    bool clock = sim.digitalRead(A4);
+    double start = nowNs();
+    panel.processClockCycle();
+    double ns = nowNs() - start - overhead;
+    if (ns < 0)
+      ns = 0;
+    decodeNs += ns;
+
+    int path = IDLE;
+    if (panel.atTransmissionEnd()){
+      path = FRAME_END;
+      frames++;
+      if (panel.keyPressed() == '5')
+        keysSeen++;
+    }
+    else if (clock && !lastClock)
+      path = CONTROLLER;
+    else if (!clock && lastClock)
+      path = KEYPAD;
+    add(paths[path], ns);
+    lastClock = clock;
+  }
+
+  drain(sim, panel, 50, frames, keysSeen);
+
+  printf("decoder latency per processClockCycle() call (timer overhead %.0f ns removed)\n", overhead);
+  for (int p = 0; p < PATHS; p++)
+    print(pathNames[p], paths[p]);
+
+  printf("\nframes decoded     %lu of %lu\n", frames, sim.framesSent());
+  printf("keys seen          %lu of %lu\n", keysSeen, keysPressed);
+  bool ok = frames == sim.framesSent() && keysSeen == keysPressed;
+  printf("decode throughput  %.0f frames/s of CPU time\n", frames / (decodeNs / 1e9));
+
+  //find the longest polling interval that loses nothing.  Losses don't
+  //grow monotonically with the interval (polls can happen to line up with
+  //the bus), so the answer is the end of the first lossless run.  The
+  //default timer sampling period at least has to be in it
+  for (int filtered = 0; filtered < 2; filtered++){
+    unsigned long safe = 0;
+    for (unsigned long poll = 50; poll <= 1200; poll += 25){
+      if (!lossless(poll, jitter, seconds < 20 ? seconds : 20, filtered))
+        break;
+      safe = poll;
+    }
+    printf("max safe polling   %lu us (bus jitter +/-%lu us%s)\n", safe, jitter,
+           filtered ? ", glitch filter" : "");
+    ok = ok && safe >= PC1550_TIMER_SAMPLE_US;
+  }
+
+  //one read in 500 wrong, polling every 200us
+  printf("\nnoisy bus          frames    valid  false changes  corrected  clock glitches  ns/poll\n");
+  for (int filtered = 0; filtered < 2; filtered++){
+    Noise noise = noisy(500, filtered, seconds);
+    printf("  filter %-3s    %9lu %8lu %14lu %10u %15u %8.1f\n", filtered ? "on" : "off",
+           noise.frames, noise.valid, noise.falseChanges, noise.diag.bitsCorrected,
+           noise.diag.clockGlitches, noise.nsPerPoll);
+    if (filtered)
+      ok = ok && noise.valid == noise.frames && noise.falseChanges == 0;
+  }
+
+  //a frame lasts about 51ms, so anything up to one frame plus the time
+  //to the start of the next is the best a decoder can do
+  printf("\n                   mean     worst  wrong keys\n");
+  const char *startNames[] = { "first frame", "after 2ms stall", "after 5ms stall" };
+  const unsigned long stalls[] = { 0, 2000, 5000 };
+  for (int i = 0; i < 3; i++){
+    uint32_t seed = 99;
+    double total = 0;
+    unsigned long worst = 0, wrongKeys = 0;
+    for (int run = 0; run < 200; run++){
+      unsigned long t = firstFrame(seed, stalls[i], wrongKeys);
+      total += t;
+      if (t > worst)
+        worst = t;
+    }
+    printf("  %-16s %5.1f ms %6.1f ms %11lu\n", startNames[i], total / 200 / 1000,
+           worst / 1000.0, wrongKeys);
+    ok = ok && wrongKeys == 0;
+  }
+
+  //a stall across the gap must never make a bit further into the cycle
+  //pass for its first, or a key goes out at the wrong bit positions
+  uint32_t seed = 7;
+  printf("\nkeys through a stall across the gap\n");
+  for (int scanned = 0; scanned < 2; scanned++){
+    StallKeys stalled = stallKeys(seed, 100, scanned);
+    printf("  %-9s %lu sent, %lu received, %lu confirmed, %lu wrong\n",
+           scanned ? "scanned" : "polled", stalled.stalls,
+           stalled.received, stalled.confirmed, stalled.wrong);
+    ok = ok && stalled.wrong == 0 && stalled.received > 0 &&
+         stalled.received == stalled.confirmed;
+  }
+
+  printf("\nns per sample      scanned   polled\n");
+  for (uint8_t buses = 1; buses <= 4; buses++)
+    printf("  %u bus%s         %8.1f %8.1f\n", buses, buses > 1 ? "es" : "  ",
+           multiBus(buses, true, seconds / 4), multiBus(buses, false, seconds / 4));
+  return ok ? 0 : 1;
+}
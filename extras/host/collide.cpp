@@ -0,0 +1,131 @@
+/*
+ * Sends codes while someone keeps pressing keys on another keypad.
+ *
+ *   ./collide [press_one_in] [codes]
+ *
+ * Sends a code of 1234 the given number of times (40 by default) through
+ * sendKeys() on the simulated panel.  Meanwhile, at the start of about one
+ * transmission in press_one_in (4 by default, 0 for never), a key is
+ * pressed on a physical keypad, so now and then both keypads send in the
+ * same transmission and the panel reads the two keys on top of each other.
+ * Prints the collisions seen, the keys sent again and how each code ended.
+ * The exit status is non-zero if the panel didn't receive exactly the keys
+ * of a code that was reported sent (a key lost or pressed twice), received
+ * more than the start of one that failed, or if a collision went unseen.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PC1550.h"
+#include "PC1550Sim.h"
+
+static const char CODE[] = "1234";
+
+//the key pressed on the other keypad.  None of its bits on top of a key
+//of the code make another key, so the panel reads those as '?'
+static const char OTHER = '9';
+
+//the keys the panel received that came from us
+static void ownKeys(const char *received, char *keys, size_t size){
+  size_t n = 0;
+  for (; *received && n < size - 1; received++)
+    if (*received != OTHER && *received != '?')
+      keys[n++] = *received;
+  keys[n] = '\0';
+}
+
+int main(int argc, char **argv){
+  unsigned long oneIn = argc > 1 ? strtoul(argv[1], 0, 10) : 4;
+  unsigned long codes = argc > 2 ? strtoul(argv[2], 0, 10) : 40;
+  const unsigned long poll = 200;
+
+  PC1550Sim sim;
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+
+  //let the decoder find the bus first
+  while (panel.snapshot().sequence < 3){
+    sim.advance(poll);
+    panel.processClockCycle();
+  }
+  panel.resetDiagnostics();
+
+  uint32_t seed = 12345;
+  unsigned long frames = sim.framesSent();
+  unsigned long sent = 0, failed = 0, wrong = 0, presses = 0;
+  unsigned long collisionEvents = 0, missedEvents = 0;
+  PC1550::Event events[8];
+
+  for (unsigned long i = 0; i < codes; i++){
+    sim.clearKeysReceived();
+    uint8_t sequence = panel.sendKeys(CODE);
+    if (sequence == 0){
+      fprintf(stderr, "code %lu refused\n", i);
+      return 1;
+    }
+
+    //the decoder finishes a frame before the panel acts on it, so the
+    //panel's keys are read once it has clocked out the next one
+    bool done = false;
+    while (true){
+      sim.advance(poll);
+      panel.processClockCycle();
+
+      if (sim.framesSent() != frames){
+        frames = sim.framesSent();
+        if (done)
+          break;
+        seed = seed * 1103515245 + 12345;
+        if (oneIn != 0 && (seed >> 16) % oneIn == 0){
+          sim.pressKey(OTHER);
+          presses++;
+        }
+      }
+
+      uint8_t n = panel.readEvents(events, 8);
+      for (uint8_t e = 0; e < n; e++){
+        if (events[e].type == PC1550::KEY_COLLISION)
+          collisionEvents++;
+        else if (events[e].type == PC1550::KEY_MISSED)
+          missedEvents++;
+      }
+
+      if (panel.atTransmissionEnd() && panel.keysDone() == sequence)
+        done = true;
+    }
+
+    char keys[64];
+    ownKeys(sim.keysReceived(), keys, sizeof(keys));
+    if (panel.keysDoneSent()){
+      sent++;
+      if (strcmp(keys, CODE) != 0){
+        printf("code %lu sent, but the panel received %s\n", i, keys);
+        wrong++;
+      }
+    }
+    else{
+      failed++;
+      if (strncmp(keys, CODE, strlen(keys)) != 0 || strlen(keys) == strlen(CODE)){
+        printf("code %lu failed, but the panel received %s\n", i, keys);
+        wrong++;
+      }
+    }
+  }
+
+  PC1550::Diagnostics diag = panel.readDiagnostics();
+  printf("other keypad       %lu presses\n", presses);
+  printf("keys sent          %u transmissions, %u confirmed\n",
+         diag.keysSent, diag.keysConfirmed);
+  printf("collisions         %u (%lu events), %u missed (%lu events)\n",
+         diag.keyCollisions, collisionEvents, diag.keysMissed, missedEvents);
+  printf("keys sent again    %u\n", diag.keyRetries);
+  printf("codes              %lu sent, %lu failed, %lu received wrongly\n",
+         sent, failed, wrong);
+
+  bool ok = wrong == 0 &&
+    collisionEvents == diag.keyCollisions && missedEvents == diag.keysMissed &&
+    (oneIn == 0 || diag.keyCollisions > 0);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+/*
+ * Keeps a run-length encoded history of a simulated panel and checks it.
+ *
+ *   ./history [minutes] [seconds_between_changes]
+ *
+ * Runs the simulated panel for the given number of simulated minutes (60
+ * by default), opening or closing a zone about every so many seconds (30
+ * by default) and now and then beeping, and feeds every frame to a
+ * PC1550History.  Every frame is also kept in full on the host.  At the
+ * end, the state the history gives for each frame it still covers, its
+ * last transitions, and the states it gives for times in ms are compared
+ * with that full record.  Prints how far back the history reaches and the
+ * bytes it takes.  A second history is then fed two months of frames to
+ * check its frame period survives micros() wrapping.  The exit status is
+ * non-zero on any difference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "PC1550.h"
+#include "PC1550History.h"
+#include "PC1550Sim.h"
+
+struct Frame {
+  uint16_t controller;
+  uint16_t pc16out;
+  unsigned long time;
+};
+
+static bool sameState(const Frame &frame, const PC1550HistoryEntry &entry){
+  return frame.controller == entry.controller && frame.pc16out == entry.pc16out;
+}
+
+static bool sameState(const Frame &a, const Frame &b){
+  return a.controller == b.controller && a.pc16out == b.pc16out;
+}
+
+int main(int argc, char **argv){
+  unsigned long minutes = argc > 1 ? strtoul(argv[1], 0, 10) : 60;
+  unsigned long every = argc > 2 ? strtoul(argv[2], 0, 10) : 30;
+  const unsigned long poll = 400;
+
+  PC1550Sim sim;
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+  PC1550History history;
+  std::vector<Frame> frames;
+
+  uint16_t lights = PC1550::READY_LIGHT;
+  uint16_t tripped = 0;
+  sim.setControllerData(lights);
+
+  //about one frame in this many changes a zone, and one in ten of those
+  //beeps instead
+  unsigned long frameUs = PC1550_SYNC_GAP_US + 16UL * PC1550_BIT_PERIOD_US;
+  unsigned long oneIn = every * 1000000UL / frameUs;
+  if (oneIn == 0)
+    oneIn = 1;
+
+  uint32_t seed = 2024;
+  unsigned long simFrames = sim.framesSent();
+  uint32_t sequence = 0;
+  unsigned long end = minutes * 60000000UL;
+  bool beep = false;
+
+  while (micros() < end){
+    sim.advance(poll);
+    panel.processClockCycle();
+    history.update(panel);
+
+    PC1550::Snapshot snap = panel.snapshot();
+    if (snap.sequence != sequence && snap.sequence != 0){
+      if (sequence != 0 && snap.sequence != sequence + 1){
+        fprintf(stderr, "frame %lu lost\n", (unsigned long)sequence + 1);
+        return 1;
+      }
+      sequence = snap.sequence;
+      Frame frame = {snap.controller, snap.pc16out, snap.time};
+      frames.push_back(frame);
+    }
+
+    if (sim.framesSent() == simFrames)
+      continue;
+    simFrames = sim.framesSent();
+
+    seed = seed * 1103515245 + 12345;
+    uint16_t controller = lights;
+    if (beep)
+      beep = false;
+    else if ((seed >> 16) % oneIn == 0){
+      seed = seed * 1103515245 + 12345;
+      uint8_t zone = (seed >> 16) % 10;
+      if (zone >= 6)
+        beep = true;
+      else{
+        lights ^= PC1550::ZONE1_LIGHT >> zone;
+        tripped ^= PC1550::ZONE1_TRIPPED >> zone;
+        lights = (lights & 0xFC00) ? lights & ~PC1550::READY_LIGHT
+                                   : lights | PC1550::READY_LIGHT;
+        controller = lights;
+      }
+    }
+    sim.setControllerData(beep ? controller | PC1550::BEEPING : controller);
+    sim.setPC16OutData(tripped);
+  }
+
+  bool ok = true;
+  uint32_t latest = frames.size() - 1;
+  uint32_t span = history.spanFrames();
+  if (span > frames.size()){
+    printf("history spans %lu frames of %lu\n", (unsigned long)span,
+           (unsigned long)frames.size());
+    return 1;
+  }
+
+  //every frame still covered, and where its state began and ended
+  unsigned long wrong = 0;
+  for (uint32_t ago = 0; ago < span; ago++){
+    PC1550HistoryEntry entry;
+    uint32_t index = latest - ago;
+    if (!history.stateFramesAgo(ago, entry) || !sameState(frames[index], entry) ||
+        entry.framesAgo < ago || entry.framesAgo - entry.frames + 1 > ago){
+      wrong++;
+      continue;
+    }
+    uint32_t first = latest - entry.framesAgo;
+    uint32_t last = first + entry.frames - 1;
+    if ((first > 0 && ago != span - 1 && entry.framesAgo != span - 1 &&
+         sameState(frames[first - 1], frames[first])) ||
+        (last < latest && sameState(frames[last + 1], frames[last])))
+      wrong++;
+  }
+  PC1550HistoryEntry entry;
+  if (history.stateFramesAgo(span, entry))
+    wrong++;
+  printf("frames             %lu, %lu wrong\n", (unsigned long)span, wrong);
+  ok &= wrong == 0;
+
+  //the last transitions against the full record
+  PC1550HistoryEntry last[8];
+  uint8_t n = history.lastTransitions(last, 8);
+  uint32_t index = latest;
+  wrong = 0;
+  for (uint8_t i = 0; i < n; i++){
+    uint32_t first = index;
+    while (first > 0 && sameState(frames[first - 1], frames[index]))
+      first--;
+    if (!sameState(frames[index], last[i]) || last[i].framesAgo != latest - first)
+      wrong++;
+    printf("%s%9.1f s ago  lights %04x  pc16out %04x  for %lu frames\n",
+           i == 0 ? "last transitions " : "                 ",
+           last[i].msAgo / 1000.0, last[i].controller, last[i].pc16out,
+           (unsigned long)last[i].frames);
+    index = first - 1;
+  }
+  ok &= wrong == 0 && n == (history.transitions() + 1 < 8 ? history.transitions() + 1 : 8);
+
+  //states by time, which can be a frame out where the period wanders
+  wrong = 0;
+  unsigned long checked = 0;
+  unsigned long spanMs = history.spanMs();
+  for (unsigned long ms = 0; ms + 1000 < spanMs; ms += 997){
+    if (!history.stateMsAgo(ms, entry))
+      continue;
+    checked++;
+    unsigned long at = frames[latest].time - ms * 1000UL;
+    uint32_t i = latest;
+    while (i > 0 && frames[i].time > at)
+      i--;
+    bool near = sameState(frames[i], entry) ||
+                (i < latest && sameState(frames[i + 1], entry)) ||
+                (i > 0 && sameState(frames[i - 1], entry));
+    if (!near)
+      wrong++;
+  }
+  printf("times              %lu checked, %lu wrong\n", checked, wrong);
+  ok &= wrong == 0 && checked > 0;
+
+  //two months of frames on a 32 bit micros() clock, well past where it
+  //wraps and where a total in ms or us would have overflowed
+  PC1550History longRun;
+  const uint32_t periodUs = 51350;
+  uint32_t now = 0;
+  for (uint32_t n = 0; n < 101000000UL; n++){
+    longRun.addFrame(0, 0, now);
+    now += periodUs;
+  }
+  unsigned long longMs = longRun.framesToMs(10000);
+  uint32_t longFrames = longRun.msToFrames(513500);
+  printf("after 60 days      10000 frames %lu ms, 513500 ms %lu frames\n",
+         longMs, (unsigned long)longFrames);
+  ok &= longMs + 1 >= 513500 && longMs <= 513501 &&
+        longFrames + 1 >= 10000 && longFrames <= 10001;
+
+  printf("history            %u transitions in %u of %u bytes\n",
+         history.transitions(), history.bytesUsed(), PC1550_HISTORY_BYTES);
+  printf("lookback           %.1f of %lu minutes\n", spanMs / 60000.0, minutes);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+/*
+ * Runs keypad macros against the simulated panel.
+ *
+ *   ./macro [poll_us]
+ *
+ * The simulated panel is given a little of a real panel's logic: a code
+ * of 1234 arms it (the ready light goes out and the armed light comes on)
+ * two frames after the last key, and the next 1234 disarms it.  Against
+ * that, runs an arm macro, a disarm macro whose first code the panel
+ * ignores (so it has to time out and send the code again), one that waits
+ * for a light the panel never lights (so it fails), and one that waits for
+ * the beep acknowledging a key.  Prints how long each took and in which
+ * frame it finished.  The exit status is non-zero if a macro ends
+ * differently than it should, or finishes in any frame but the one that
+ * first showed the change it waited for.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PC1550.h"
+#include "PC1550Macro.h"
+#include "PC1550Sim.h"
+
+//the lights the macros look at
+static const uint16_t READY = PC1550::READY_LIGHT;
+static const uint16_t ARMED = PC1550::ARMED_LIGHT;
+
+static const PC1550MacroStep armAway[] = {
+  PC1550_MACRO_SEND("1234", 2),
+  PC1550_MACRO_WAIT_LIGHTS(ARMED | READY, ARMED, 3000, 2),
+  PC1550_MACRO_END
+};
+
+static const PC1550MacroStep disarm[] = {
+  PC1550_MACRO_SEND("1234", 2),
+  PC1550_MACRO_WAIT_LIGHTS(ARMED | READY, READY, 1000, 2),
+  PC1550_MACRO_END
+};
+
+static const PC1550MacroStep bypassZone1[] = {
+  PC1550_MACRO_SEND("*1", 1),
+  PC1550_MACRO_WAIT_LIGHTS(PC1550::BYPASS_LIGHT, PC1550::BYPASS_LIGHT, 500, 1),
+  PC1550_MACRO_END
+};
+
+static const PC1550MacroStep chime[] = {
+  PC1550_MACRO_SEND("5", 0),
+  PC1550_MACRO_WAIT_BEEPS(1, 1000, 0),
+  PC1550_MACRO_END
+};
+
+//the simulated panel and what it does with the keys it receives
+static PC1550Sim sim;
+static uint16_t lights = READY;
+static size_t keysSeen = 0;
+static int ignoreCodes = 0;
+static int armIn = -1;
+
+//acts on the keys received since the last frame
+static void panelLogic(){
+  const char *keys = sim.keysReceived();
+  size_t n = strlen(keys);
+  if (n != keysSeen && n >= 4 && strcmp(keys + n - 4, "1234") == 0){
+    if (ignoreCodes > 0)
+      ignoreCodes--;
+    else
+      armIn = 2;
+  }
+  keysSeen = n;
+
+  if (armIn >= 0 && armIn-- == 0){
+    lights = (lights & ARMED) ? READY : ARMED;
+    sim.setControllerData(lights);
+  }
+}
+
+struct Result {
+  uint8_t status;
+  unsigned long ms;
+  uint16_t retries;
+  uint8_t step;
+  uint32_t frame;        //the frame the macro finished in
+  uint32_t firstShown;   //the first frame that showed its lights
+};
+
+static Result run(PC1550 &panel, const PC1550MacroStep *steps,
+                  uint16_t mask, uint16_t value, unsigned long poll){
+  PC1550Macro macro(panel);
+  Result result;
+  result.firstShown = 0;
+  macro.start(steps);
+  unsigned long frames = sim.framesSent();
+  while (macro.update() == PC1550Macro::RUNNING){
+    sim.advance(poll);
+    panel.processClockCycle();
+    if (sim.framesSent() != frames){
+      frames = sim.framesSent();
+      panelLogic();
+    }
+    if (panel.atTransmissionEnd() && result.firstShown == 0 && mask != 0 &&
+        (panel.snapshot().controller & mask) == value)
+      result.firstShown = panel.snapshot().sequence;
+  }
+  result.status = macro.status();
+  result.ms = macro.elapsedMs();
+  result.retries = macro.retries();
+  result.step = macro.step();
+  result.frame = panel.snapshot().sequence;
+  return result;
+}
+
+static const char *statusName(uint8_t status){
+  return status == PC1550Macro::DONE ? "done" :
+         status == PC1550Macro::FAILED ? "failed" : "running";
+}
+
+static bool report(const char *name, const Result &r, uint8_t expected){
+  printf("%-18s %-6s in %5lu ms, %u retries, step %u", name,
+         statusName(r.status), r.ms, r.retries, r.step);
+  if (r.firstShown != 0)
+    printf(", frame %lu (first shown %lu)", (unsigned long)r.frame,
+           (unsigned long)r.firstShown);
+  printf("\n");
+  return r.status == expected &&
+    (expected != PC1550Macro::DONE || r.firstShown == 0 ||
+     r.frame == r.firstShown);
+}
+
+int main(int argc, char **argv){
+  unsigned long poll = argc > 1 ? strtoul(argv[1], 0, 10) : 200;
+
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+  sim.setControllerData(lights);
+
+  //let the decoder find the bus first
+  while (panel.snapshot().sequence < 3){
+    sim.advance(poll);
+    panel.processClockCycle();
+  }
+
+  bool ok = true;
+  ok &= report("arm", run(panel, armAway, ARMED | READY, ARMED, poll),
+               PC1550Macro::DONE);
+  ignoreCodes = 1;
+  Result r = run(panel, disarm, ARMED | READY, READY, poll);
+  ok &= report("disarm (retried)", r, PC1550Macro::DONE) && r.retries == 1;
+  r = run(panel, bypassZone1, 0, 0, poll);
+  ok &= report("bypass (no light)", r, PC1550Macro::FAILED) && r.step == 1;
+  ok &= report("key beep", run(panel, chime, 0, 0, poll), PC1550Macro::DONE);
+  printf("keys received      %s\n", sim.keysReceived());
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/*
+ * Publishes the panel state to shared memory for any number of readers.
+ *
+ *   ./pc1550d [-t] source [name]
+ *   ./pc1550d -g /dev/gpiochip0 data clock pgm [name]
+ *
+ * Reads a stream from source (a serial port, a pty, a FIFO or a file) and
+ * publishes every update to the shared memory segment name (/pc1550 by
+ * default, see PC1550Shm.h).  The stream is binary telemetry from
+ * PC1550TelemetryWriter, or with -t a bus trace from PC1550TraceWriter,
+ * which is run through the PC1550 decoder itself as replay does.  A tty
+ * is switched to raw mode at 115200 baud.  Runs until the stream ends or
+ * it is interrupted, and leaves the segment in place with the last state
+ * (and writerPid 0) when it exits.
+ *
+ * With -g, the panel is wired straight to three lines of a GPIO chip and
+ * decoded on a PC1550Thread (on the last CPU, at real-time priority when
+ * allowed).  Its frames are picked up every millisecond.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "PC1550.h"
+#include "PC1550Gpio.h"
+#include "PC1550Replay.h"
+#include "PC1550Shm.h"
+#include "PC1550Telemetry.h"
+#include "PC1550Thread.h"
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int){
+  stopping = 1;
+}
+
+static uint64_t monotonicNs(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//publishes state, filling in what changed since the previous update
+static void publish(PC1550Shm *shm, PC1550ShmState &last, PC1550ShmState state){
+  state.controllerChanged = state.controller ^ last.controller;
+  state.pc16outChanged = state.pc16out ^ last.pc16out;
+  state.keypadChanged = state.keypad ^ last.keypad;
+  state.updates = last.updates + 1;
+  state.updatedNs = monotonicNs();
+  PC1550ShmWrite(shm, state);
+  last = state;
+}
+
+static int decodeGpio(int argc, char **argv){
+  if (argc < 6){
+    fprintf(stderr, "usage: %s -g chip data clock pgm [name]\n", argv[0]);
+    return 2;
+  }
+  uint8_t data = atoi(argv[3]), clock = atoi(argv[4]), pgm = atoi(argv[5]);
+  const char *name = argc > 6 ? argv[6] : PC1550_SHM_NAME;
+
+  PC1550LinuxGpio gpio(argv[2], data, clock, pgm);
+  if (!gpio.open()){
+    perror(argv[2]);
+    return 2;
+  }
+  PC1550Shm *shm = PC1550ShmOpen(name, true);
+  if (shm == 0){
+    perror(name);
+    return 2;
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  PC1550SetBackend(&gpio);
+  PC1550 panel(data, clock, pgm);
+  PC1550Thread decoder(panel);
+  if (!decoder.start(sysconf(_SC_NPROCESSORS_ONLN) - 1)){
+    fprintf(stderr, "can't start the decoder thread\n");
+    return 2;
+  }
+
+  PC1550ShmState last;
+  memset(&last, 0, sizeof(last));
+  uint32_t frames = 0;
+  while (!stopping){
+    usleep(1000);
+    PC1550ThreadState decoded;
+    if (!decoder.read(decoded) || decoded.snapshot.sequence == frames)
+      continue;
+    frames = decoded.snapshot.sequence;
+    PC1550ShmState state;
+    memset(&state, 0, sizeof(state));
+    state.controller = decoded.snapshot.controller;
+    state.pc16out = decoded.snapshot.pc16out;
+    state.keypad = decoded.snapshot.keypad;
+    state.valid = 1;
+    state.consecutiveBeeps = decoded.snapshot.consecutiveBeeps;
+    state.consecutiveKeyPresses = decoded.snapshot.consecutiveKeyPresses;
+    publish(shm, last, state);
+  }
+
+  decoder.stop();
+  shm->writerPid = 0;
+  PC1550ShmClose(shm);
+  return 0;
+}
+
+int main(int argc, char **argv){
+  if (argc > 1 && strcmp(argv[1], "-g") == 0)
+    return decodeGpio(argc, argv);
+
+  bool trace = argc > 1 && strcmp(argv[1], "-t") == 0;
+  int first = trace ? 2 : 1;
+  if (argc <= first){
+    fprintf(stderr, "usage: %s [-t] source [name]\n", argv[0]);
+    return 2;
+  }
+  const char *source = argv[first];
+  const char *name = argc > first + 1 ? argv[first + 1] : PC1550_SHM_NAME;
+
+  int fd = open(source, O_RDONLY | O_NOCTTY);
+  if (fd < 0){
+    perror(source);
+    return 2;
+  }
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0){
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, B115200);
+    cfsetospeed(&tio, B115200);
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+
+  PC1550Shm *shm = PC1550ShmOpen(name, true);
+  if (shm == 0){
+    perror(name);
+    return 2;
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  //only one decoder is needed, but the replay backend has to be in place
+  //before the PC1550 is constructed
+  PC1550Replay replay;
+  PC1550SetBackend(&replay);
+  PC1550 panel;
+  replay.attach(&panel);
+  PC1550TelemetryReader telemetry;
+
+  PC1550ShmState last;
+  memset(&last, 0, sizeof(last));
+  uint32_t frames = 0;
+  int status = 0;
+
+  while (!stopping){
+    //a quiet line ends any packet in progress (see idle())
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int ready = poll(&pfd, 1, 20);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    if (ready == 0){
+      if (!trace && telemetry.idle() != PC1550TelemetryReader::MORE){
+        PC1550ShmState state = last;
+        state.valid = 0;
+        state.packetsLost++;
+        publish(shm, last, state);
+      }
+      continue;
+    }
+
+    uint8_t bytes[256];
+    ssize_t n = read(fd, bytes, sizeof(bytes));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+
+    for (ssize_t i = 0; i < n; i++){
+      PC1550ShmState state;
+      memset(&state, 0, sizeof(state));
+
+      if (trace){
+        //one byte completes at most one record, and so at most one frame
+        if (!replay.feed(bytes + i, 1)){
+          fprintf(stderr, "%s: not a PC1550 trace\n", source);
+          status = 1;
+          stopping = 1;
+          break;
+        }
+        PC1550::Snapshot snap = panel.snapshot();
+        if (snap.sequence == frames)
+          continue;
+        frames = snap.sequence;
+        state.controller = snap.controller;
+        state.pc16out = snap.pc16out;
+        state.keypad = snap.keypad;
+        state.valid = 1;
+        state.consecutiveBeeps = snap.consecutiveBeeps;
+        state.consecutiveKeyPresses = snap.consecutiveKeyPresses;
+      }
+      else{
+        uint8_t result = telemetry.push(bytes[i]);
+        if (result == PC1550TelemetryReader::MORE)
+          continue;
+        state.controller = telemetry.controller;
+        state.pc16out = telemetry.pc16out;
+        state.keypad = telemetry.keypad;
+        state.valid = telemetry.valid;
+        state.packetsLost = telemetry.packetsLost + telemetry.crcErrors;
+      }
+      publish(shm, last, state);
+    }
+  }
+
+  shm->writerPid = 0;
+  PC1550ShmClose(shm);
+  close(fd);
+  return status;
+}
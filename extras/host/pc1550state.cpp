@@ -0,0 +1,99 @@
+/*
+ * Reads the panel state published by pc1550d.
+ *
+ *   ./pc1550state [-w | -b] [name]
+ *
+ * Prints the current state from the shared memory segment name (/pc1550
+ * by default).  With -w, prints every update until interrupted or until
+ * pc1550d exits.  With -b, times a million snapshots and prints the cost
+ * of one.  The exit status is non-zero if the segment can't be read or
+ * holds no valid state, or if pc1550d died without saying so while being
+ * watched.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "PC1550.h"
+#include "PC1550Shm.h"
+
+static double wallSeconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//true while the daemon that published the segment is running.  One that
+//was killed never clears writerPid, so the process itself is looked for
+static bool writerRunning(PC1550Shm *shm){
+  pid_t pid = (pid_t)shm->writerPid;
+  if (pid == 0)
+    return false;
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+static void printState(const PC1550ShmState &state){
+  printf("%6lu %s controller %04X  pc16out %04X  keypad %02X%s%s%s\n",
+         (unsigned long)state.updates, state.valid ? " " : "?",
+         state.controller, state.pc16out, state.keypad,
+         (state.controller & PC1550::ARMED_LIGHT) ? "  armed" : "",
+         (state.pc16out & PC1550::ALARM_TRIPPED) ? "  tripped" : "",
+         (state.controller & PC1550::BEEPING) ? "  beep" : "");
+}
+
+int main(int argc, char **argv){
+  bool watch = argc > 1 && strcmp(argv[1], "-w") == 0;
+  bool bench = argc > 1 && strcmp(argv[1], "-b") == 0;
+  int first = watch || bench ? 2 : 1;
+  const char *name = argc > first ? argv[first] : PC1550_SHM_NAME;
+
+  PC1550Shm *shm = PC1550ShmOpen(name, false);
+  PC1550ShmState state;
+  if (shm == 0 || !PC1550ShmRead(shm, state)){
+    fprintf(stderr, "%s: %s\n", name, shm == 0 ? strerror(errno) : "not a pc1550d segment");
+    return 2;
+  }
+
+  if (bench){
+    const long reads = 1000000;
+    volatile uint16_t sink;
+    double start = wallSeconds();
+    for (long i = 0; i < reads; i++){
+      PC1550ShmRead(shm, state);
+      sink = state.controller;
+    }
+    (void)sink;
+    double elapsed = wallSeconds() - start;
+    printf("snapshot           %.1f ns\n", elapsed / reads * 1e9);
+  }
+  else if (watch){
+    uint32_t seen = state.updates;
+    printState(state);
+    while (writerRunning(shm)){
+      usleep(1000);
+      PC1550ShmRead(shm, state);
+      if (state.updates != seen){
+        seen = state.updates;
+        printState(state);
+      }
+    }
+    if (shm->writerPid != 0){
+      fprintf(stderr, "%s: pc1550d (pid %lu) died without closing it\n",
+              name, (unsigned long)shm->writerPid);
+      PC1550ShmClose(shm);
+      return 2;
+    }
+  }
+  else{
+    printState(state);
+    if (!writerRunning(shm))
+      printf("       (pc1550d is not running)\n");
+  }
+
+  PC1550ShmClose(shm);
+  return state.valid ? 0 : 1;
+}
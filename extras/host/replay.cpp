@@ -0,0 +1,88 @@
+/*
+ * Replays a bus trace through the PC1550 decoder as fast as possible.
+ *
+ *   ./replay trace.bin [-v]
+ *
+ * Prints the decode throughput and, with -v, every event the decoder
+ * records along the way.  The exit status is non-zero if no frame could
+ * be decoded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "PC1550.h"
+#include "PC1550Replay.h"
+
+static const char *eventNames[] = {
+  "light on", "light off", "key press", "key release",
+  "beep start", "beep stop", "pc16out on", "pc16out off",
+  "keys sent", "keys failed", "key collision", "key missed"
+};
+
+static double wallSeconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv){
+  if (argc < 2){
+    fprintf(stderr, "usage: %s trace.bin [-v]\n", argv[0]);
+    return 2;
+  }
+  bool verbose = argc > 2 && strcmp(argv[2], "-v") == 0;
+
+  FILE *in = fopen(argv[1], "rb");
+  if (in == 0){
+    perror(argv[1]);
+    return 2;
+  }
+  fseek(in, 0, SEEK_END);
+  long size = ftell(in);
+  fseek(in, 0, SEEK_SET);
+  uint8_t *trace = (uint8_t *)malloc(size > 0 ? size : 1);
+  if (fread(trace, 1, size, in) != (size_t)size){
+    perror(argv[1]);
+    return 2;
+  }
+  fclose(in);
+
+  PC1550Replay replay;
+  PC1550SetBackend(&replay);
+  PC1550 panel;
+  replay.attach(&panel);
+
+  //feed the trace a chunk at a time, reporting frames between chunks
+  unsigned long frames = 0;
+  double start = wallSeconds();
+  for (long offset = 0; offset < size; offset += 64){
+    long chunk = size - offset < 64 ? size - offset : 64;
+    if (!replay.feed(trace + offset, chunk)){
+      fprintf(stderr, "%s: not a PC1550 trace\n", argv[1]);
+      return 1;
+    }
+    PC1550::Event event;
+    while (panel.readEvent(event)){
+      if (!verbose)
+        continue;
+      if (event.type == PC1550::KEY_PRESS || event.type == PC1550::KEY_RELEASE)
+        printf("%12lu us  %-12s %c\n", event.time, eventNames[event.type], event.value);
+      else
+        printf("%12lu us  %-12s %u\n", event.time, eventNames[event.type], event.value);
+    }
+  }
+  double elapsed = wallSeconds() - start;
+  frames = replay.framesDecoded();
+
+  double traced = replay.micros() / 1e6;
+  printf("trace              %ld bytes, %.1f s of bus traffic\n", size, traced);
+  printf("records            %lu (%lu gaps)\n", replay.recordsReplayed(), replay.gapsSeen());
+  printf("frames decoded     %lu\n", frames);
+  printf("replay time        %.3f s (%.0fx real time, %.0f frames/s)\n",
+         elapsed, traced / elapsed, frames / elapsed);
+  free(trace);
+  return frames > 0 ? 0 : 1;
+}
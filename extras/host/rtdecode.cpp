@@ -0,0 +1,169 @@
+/*
+ * Runs the decoder on a real-time thread against real time.
+ *
+ *   ./rtdecode [seconds] [poll_us] [cpu]
+ *   ./rtdecode -g /dev/gpiochip0 data clock pgm [seconds] [poll_us] [cpu]
+ *
+ * The first form decodes a simulated panel kept in step with the clock
+ * (PC1550RealTimeSim) for the given number of seconds (10 by default),
+ * polling every poll_us (PC1550_THREAD_POLL_US by default) from a
+ * PC1550Thread on the given CPU, and enters a code through the thread
+ * along the way, after a sequence the panel refuses.  The main thread reads the published state every
+ * millisecond as a consumer would.  Prints the frames decoded against
+ * those sent, the longest poll gap the decoder saw, and the cost of a
+ * read.  The exit status is non-zero if frames were lost, anything
+ * decoded differs from what the panel sent, or the refused sequence held
+ * up the code.
+ *
+ * With -g, decodes a real panel wired to three lines of a GPIO chip and
+ * prints every frame that changed something.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "PC1550.h"
+#include "PC1550Gpio.h"
+#include "PC1550Sim.h"
+#include "PC1550Thread.h"
+
+static double wallSeconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//ns per read() of the published state, with the decoder running
+static double readCost(PC1550Thread &decoder){
+  const long reads = 1000000;
+  PC1550ThreadState state;
+  volatile uint16_t sink;
+  double start = wallSeconds();
+  for (long i = 0; i < reads; i++){
+    decoder.read(state);
+    sink = state.snapshot.controller;
+  }
+  (void)sink;
+  return (wallSeconds() - start) / reads * 1e9;
+}
+
+static int decodeGpio(int argc, char **argv){
+  if (argc < 6){
+    fprintf(stderr, "usage: %s -g chip data clock pgm [seconds] [poll_us] [cpu]\n", argv[0]);
+    return 2;
+  }
+  uint8_t data = atoi(argv[3]), clock = atoi(argv[4]), pgm = atoi(argv[5]);
+  double seconds = argc > 6 ? atof(argv[6]) : 0;
+  unsigned long poll = argc > 7 ? strtoul(argv[7], 0, 10) : PC1550_THREAD_POLL_US;
+  int cpu = argc > 8 ? atoi(argv[8]) : -1;
+
+  PC1550LinuxGpio gpio(argv[2], data, clock, pgm);
+  if (!gpio.open()){
+    perror(argv[2]);
+    return 2;
+  }
+  PC1550SetBackend(&gpio);
+  PC1550 panel(data, clock, pgm);
+  PC1550Thread decoder(panel);
+  if (!decoder.start(cpu, PC1550_THREAD_PRIORITY, poll)){
+    fprintf(stderr, "can't start the decoder thread\n");
+    return 2;
+  }
+  printf("decoding %s%s\n", argv[2], decoder.realTime() ? " (real-time)" : "");
+
+  //0 seconds runs until interrupted
+  double end = wallSeconds() + seconds;
+  uint32_t seen = 0;
+  while (seconds == 0 || wallSeconds() < end){
+    usleep(1000);
+    PC1550ThreadState state;
+    if (!decoder.read(state) || state.snapshot.sequence == seen)
+      continue;
+    seen = state.snapshot.sequence;
+    if (state.snapshot.controllerChanged | state.snapshot.pc16outChanged |
+        state.snapshot.keypadChanged)
+      printf("%6lu controller %04X  pc16out %04X  keypad %02X\n",
+             (unsigned long)seen, state.snapshot.controller,
+             state.snapshot.pc16out, state.snapshot.keypad);
+    fflush(stdout);
+  }
+  decoder.stop();
+  return 0;
+}
+
+int main(int argc, char **argv){
+  if (argc > 1 && strcmp(argv[1], "-g") == 0)
+    return decodeGpio(argc, argv);
+
+  double seconds = argc > 1 ? atof(argv[1]) : 10;
+  unsigned long poll = argc > 2 ? strtoul(argv[2], 0, 10) : PC1550_THREAD_POLL_US;
+  int cpu = argc > 3 ? atoi(argv[3]) : -1;
+
+  //zones 1 and 3 open with the ready light on; panel armed on PC16-OUT
+  const uint16_t controller = 0b1010000010000000;
+  const uint16_t pc16out = 0b0000000000110000;
+  PC1550Sim sim;
+  sim.setControllerData(controller);
+  sim.setPC16OutData(pc16out);
+
+  PC1550RealTimeSim backend(sim);
+  PC1550SetBackend(&backend);
+  PC1550 panel;
+  PC1550Thread decoder(panel);
+  if (!decoder.start(cpu, PC1550_THREAD_PRIORITY, poll)){
+    fprintf(stderr, "can't start the decoder thread\n");
+    return 2;
+  }
+
+  unsigned long frames = 0, mismatches = 0;
+  uint32_t seen = 0;
+  bool refusedQueued = false, codeQueued = false;
+  double readNs = 0;
+  double end = wallSeconds() + seconds;
+  while (wallSeconds() < end){
+    usleep(1000);
+    PC1550ThreadState state;
+    if (!decoder.read(state) || state.snapshot.sequence == seen)
+      continue;
+    frames += state.snapshot.sequence - seen;
+    seen = state.snapshot.sequence;
+
+    //as in simulate, frames with keypad traffic are left out
+    if (state.snapshot.consecutiveKeyPresses == 0 &&
+        ((state.snapshot.controller & ~PC1550::BEEPING) != controller ||
+         state.snapshot.pc16out != pc16out))
+      mismatches++;
+
+    //a sequence with a character that isn't a key mustn't hold up the
+    //ones after it
+    if (!refusedQueued)
+      refusedQueued = decoder.sendKeys("12x");
+    else if (!codeQueued)
+      codeQueued = decoder.sendKeys("1234#");
+    if (readNs == 0 && seen > 10)
+      readNs = readCost(decoder);
+  }
+  decoder.stop();
+
+  PC1550::Diagnostics diag = panel.readDiagnostics();
+  printf("poll interval      %lu us on %s%s\n", poll,
+         cpu >= 0 ? "a pinned CPU" : "any CPU",
+         decoder.realTime() ? ", SCHED_FIFO" : " (no real-time priority)");
+  printf("frames sent        %lu\n", sim.framesSent());
+  printf("frames published   %lu\n", frames);
+  printf("frames mismatched  %lu\n", mismatches);
+  printf("keys received      %s (%u sequences refused)\n", sim.keysReceived(),
+         decoder.keysRefused());
+  printf("link health        %lu decoded, %u abandoned, %u resyncs, %u late keypad samples\n",
+         (unsigned long)diag.framesDecoded, diag.framesAbandoned, diag.resyncs,
+         diag.lateKeypadSamples);
+  printf("max poll gap       %lu us\n", diag.maxPollGapUs);
+  printf("state read         %.1f ns\n", readNs);
+
+  bool ok = mismatches == 0 && frames + 2 >= sim.framesSent() &&
+    strcmp(sim.keysReceived(), "1234#") == 0 && decoder.keysRefused() == 1;
+  return ok ? 0 : 1;
+}
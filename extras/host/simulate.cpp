@@ -0,0 +1,245 @@
+/*
+ * Runs the PC1550 decoder against the simulated panel.
+ *
+ *   ./simulate [poll_us] [seconds] [interrupt|oneshot|timer|sleep|budget|poll] [trace.bin]
+ *
+ * Polls processClockCycle() every poll_us of simulated time (200 by
+ * default) for the given number of simulated seconds, changing the panel
+ * state, entering a code through sendKeys() and pressing a key on a
+ * simulated physical keypad along the way.  Prints what was decoded and
+ * how much faster than real time the run was, and how much sooner the
+ * key press showed up in the first half of its frame.  The decoder is a
+ * PC1550Events, and what its handlers saw is checked against the event
+ * queue.  Events are read only every third frame, as a slow consumer
+ * would.  The exit status is non-zero if anything decoded differs from
+ * what the panel sent, or if a gap between its cycles (all nominal) is
+ * counted out of range.  With interrupt or timer, the bus is read by the
+ * clock pin interrupt or by a timer every PC1550_TIMER_SAMPLE_US, and
+ * poll_us is only how often frames are collected (and, with interrupt,
+ * how often an edge waiting on the keypad is finished).  With oneshot, the
+ * clock pin interrupt runs the timer once to finish those edges itself.
+ * With sleep, the clock pin interrupt (with the timer) reads the bus and
+ * the loop sleeps in sleepUntilEdge()
+ * instead of polling; the duty cycle printed is the share of time spent
+ * in the decoder's own delays.  With budget, the loop calls poll(poll_us)
+ * and comes back when it says the next edge is due, spending the time in
+ * between (at least 10us a turn) on other work, and prints how much of the
+ * time was left for it.  Given a file name, the bus as seen by the decoder
+ * is recorded there for ./replay.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "PC1550.h"
+#include "PC1550Sim.h"
+#include "PC1550Trace.h"
+
+//what the compile time handlers were told
+static unsigned long handledFrames = 0, handledBeeps = 0;
+static char handledKeys[16] = "";
+
+struct SimEvents : PC1550NoEvents {
+  static void onFrame(PC1550 &){
+    handledFrames++;
+  }
+  static void onKeyPress(PC1550 &, char key){
+    size_t n = strlen(handledKeys);
+    if (n < sizeof(handledKeys) - 1)
+      handledKeys[n] = key;
+  }
+  static void onBeep(PC1550 &, bool beeping){
+    if (beeping)
+      handledBeeps++;
+  }
+};
+
+static double wallSeconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv){
+  unsigned long poll = argc > 1 ? strtoul(argv[1], 0, 10) : 200;
+  double seconds = argc > 2 ? atof(argv[2]) : 10;
+  bool useInterrupts = argc > 3 && strcmp(argv[3], "interrupt") == 0;
+  bool useOneShot = argc > 3 && strcmp(argv[3], "oneshot") == 0;
+  bool useTimer = argc > 3 && strcmp(argv[3], "timer") == 0;
+  bool useSleep = argc > 3 && strcmp(argv[3], "sleep") == 0;
+  bool useBudget = argc > 3 && strcmp(argv[3], "budget") == 0;
+
+  const char *tracePath = argc > 4 ? argv[4] : 0;
+
+  PC1550Sim sim;
+  PC1550SetBackend(&sim);
+  PC1550Events<SimEvents> panel;
+  if ((useInterrupts || useOneShot || useSleep) &&
+      !panel.enableInterruptCapture(useOneShot || useSleep)){
+    fprintf(stderr, "interrupt capture unavailable\n");
+    return 2;
+  }
+  if (useTimer && !panel.enableTimerSampling()){
+    fprintf(stderr, "timer sampling unavailable\n");
+    return 2;
+  }
+
+  static uint8_t traceBuffer[4096];
+  PC1550TraceWriter recorder(traceBuffer, sizeof(traceBuffer));
+  FILE *trace = 0;
+  if (tracePath != 0){
+    trace = fopen(tracePath, "wb");
+    if (trace == 0){
+      perror(tracePath);
+      return 2;
+    }
+    recorder.begin();
+    panel.attachRecorder(&recorder);
+  }
+
+  //zones 1 and 3 open with the ready light on; panel armed on PC16-OUT
+  const uint16_t controller = 0b1010000010000000;
+  const uint16_t pc16out = 0b0000000000110000;
+  sim.setControllerData(controller);
+  sim.setPC16OutData(pc16out);
+
+  uint8_t code = 0;
+  unsigned long codeQueued = 0, codeSent = 0;
+  bool codeFailed = false;
+  bool pressed = false;
+  char sniffed = '\0';
+  unsigned long halfSeen = 0, fullSeen = 0;
+  unsigned long frames = 0, mismatches = 0;
+  char keyEvents[16] = "";
+  uint8_t keyEventCount = 0;
+  unsigned long beepEvents = 0;
+  unsigned long pollCalls = 0, inPoll = 0;
+
+  double start = wallSeconds();
+  unsigned long end = (unsigned long)(seconds * 1e6);
+  while (sim.micros() < end){
+    if (useBudget){
+      unsigned long before = sim.micros();
+      unsigned long due = panel.poll(poll);
+      inPoll += sim.micros() - before;
+      pollCalls++;
+      sim.advance(due > 10 ? due : 10);
+    }
+    else{
+      //a frame already waiting is collected before sleeping
+      if (!useSleep || !panel.sleepUntilEdge())
+        sim.advance(useSleep ? 0 : poll);
+      panel.processClockCycle();
+    }
+
+    if (trace != 0 && recorder.available() > 1024){
+      uint8_t bytes[1024];
+      fwrite(bytes, 1, recorder.read(bytes, sizeof(bytes)), trace);
+    }
+
+    if (panel.atHalfFrame() && halfSeen == 0 && panel.halfFrame().key == '5')
+      halfSeen = sim.micros();
+
+    if (!panel.atTransmissionEnd())
+      continue;
+    frames++;
+
+    //a key on the bus also masks the controller bit clocked right after
+    //each of its one bits, as it would on the wire, so only frames without
+    //keypad traffic are compared.  The beep acknowledging a key is not
+    //checked either
+    PC1550::Snapshot snap = panel.snapshot();
+    if (snap.consecutiveKeyPresses == 0 &&
+        ((snap.controller & ~PC1550::BEEPING) != controller ||
+         snap.pc16out != pc16out || snap.sequence != frames))
+      mismatches++;
+
+    if (code == 0){
+      code = panel.sendKeys("1234#");
+      codeQueued = sim.micros();
+    }
+
+    //once the code is in, press a key on the physical keypad
+    if (codeSent != 0 && !pressed && panel.readyForKeyPress()){
+      sim.pressKey('5', 3);
+      pressed = true;
+    }
+    if (panel.keyPressed() == '5' && sniffed == '\0'){
+      sniffed = '5';
+      fullSeen = sim.micros();
+    }
+
+    if (frames % 3 == 0){
+      PC1550::Event events[8];
+      uint8_t n;
+      while ((n = panel.readEvents(events, 8)) > 0)
+        for (uint8_t i = 0; i < n; i++){
+          if (events[i].type == PC1550::KEY_PRESS && keyEventCount < sizeof(keyEvents) - 1)
+            keyEvents[keyEventCount++] = events[i].value;
+          if (events[i].type == PC1550::BEEP_START)
+            beepEvents++;
+          if (events[i].value == code && events[i].type == PC1550::KEYS_SENT)
+            codeSent = events[i].time;
+          if (events[i].value == code && events[i].type == PC1550::KEYS_FAILED)
+            codeFailed = true;
+        }
+    }
+  }
+  double elapsed = wallSeconds() - start;
+
+  if (trace != 0){
+    uint8_t bytes[1024];
+    uint16_t n;
+    while ((n = recorder.read(bytes, sizeof(bytes))) > 0)
+      fwrite(bytes, 1, n, trace);
+    fclose(trace);
+  }
+
+  printf("poll interval      %lu us%s\n", poll,
+         useInterrupts ? " (interrupt capture)" :
+         useOneShot ? " (interrupt capture, one-shot timer)" :
+         useTimer ? " (timer sampling)" :
+         useSleep ? " (sleeping between edges)" :
+         useBudget ? " budget for poll()" : "");
+  printf("frames sent        %lu\n", sim.framesSent());
+  printf("frames decoded     %lu\n", frames);
+  printf("frames mismatched  %lu\n", mismatches);
+  printf("keys received      %s\n", sim.keysReceived());
+  if (codeSent != 0)
+    printf("code sent in       %.1f ms\n", (codeSent - codeQueued) / 1000.0);
+  else
+    printf("code sent in       %s\n", codeFailed ? "failed" : "-");
+  printf("keypad key seen    %c\n", sniffed ? sniffed : '-');
+  if (halfSeen != 0 && fullSeen != 0)
+    printf("seen at half frame %.1f ms sooner\n", ((long)fullSeen - (long)halfSeen) / 1000.0);
+  else
+    printf("seen at half frame -\n");
+  printf("key press events   %s (%u dropped)\n", keyEvents, panel.eventsDropped());
+  printf("handlers           %lu frames, keys %s, %lu beeps\n", handledFrames,
+         handledKeys, handledBeeps);
+  PC1550::Diagnostics diag = panel.readDiagnostics();
+  printf("link health        %lu decoded, %u abandoned, %u dropped, %u resyncs, %u gaps missed, %u out of range\n",
+         (unsigned long)diag.framesDecoded, diag.framesAbandoned, diag.framesDropped,
+         diag.resyncs, diag.syncGapsMissed, diag.syncGapsOutOfRange);
+  printf("                   %u/%u keys confirmed, %u late keypad samples, %lu us max poll gap\n",
+         diag.keysConfirmed, diag.keysSent, diag.lateKeypadSamples, diag.maxPollGapUs);
+  if (useSleep){
+    PC1550::PowerStats power = panel.readPowerStats();
+    printf("duty cycle         %.1f%% awake, %lu sleeps\n", power.dutyCycle / 10.0,
+           (unsigned long)power.sleeps);
+  }
+  if (useBudget)
+    printf("free for the loop   %.1f%% of the time, %.0f poll() calls a second\n",
+           100.0 - 100.0 * inPoll / sim.micros(), pollCalls / (sim.micros() / 1e6));
+  printf("speed              %.0fx real time\n", seconds / elapsed);
+
+  bool ok = mismatches == 0 && frames + 2 >= sim.framesSent() &&
+    strncmp(sim.keysReceived(), "1234#5", 6) == 0 && sniffed == '5' &&
+    codeSent != 0 && halfSeen != 0 && halfSeen < fullSeen &&
+    strcmp(keyEvents, "1234#5") == 0 && handledFrames == frames &&
+    strcmp(handledKeys, keyEvents) == 0 && handledBeeps == beepEvents &&
+    diag.syncGapsOutOfRange == 0;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+/*
+ * Carries decoded panel state over a pseudo-terminal as binary telemetry.
+ *
+ *   ./telemetry [seconds] [corrupt_one_in]
+ *   ./telemetry -d /dev/ttyUSB0 [baud]
+ *
+ * The first form runs the simulated panel and decoder for the given number
+ * of simulated seconds (60 by default), opening and closing zones along
+ * the way, and writes a telemetry packet for every frame to the master
+ * side of a pty as a sketch would to Serial.  The other side is read back
+ * in raw mode through PC1550TelemetryReader and checked against the
+ * decoder's snapshot after every frame.  With corrupt_one_in, about one
+ * byte in that many has a bit flipped on the way.  Prints the bytes sent
+ * against a line of text per frame, and how the reader coped.  The exit
+ * status is non-zero if the reader ever claimed a valid state that
+ * differed from the panel's.
+ *
+ * With -d, decodes telemetry arriving on a real serial port (115200 baud
+ * by default) and prints every update.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "PC1550.h"
+#include "PC1550Sim.h"
+#include "PC1550Telemetry.h"
+
+static speed_t baudRate(unsigned long baud){
+  switch (baud){
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    default: return B115200;
+  }
+}
+
+static int decodePort(const char *path, unsigned long baud){
+  int fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0){
+    perror(path);
+    return 2;
+  }
+  struct termios tio;
+  if (tcgetattr(fd, &tio) == 0){
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baudRate(baud));
+    cfsetospeed(&tio, baudRate(baud));
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+
+  //a packet takes under a millisecond at 9600 baud and up, so 20ms of
+  //silence means the line is idle
+  PC1550TelemetryReader reader;
+  uint8_t bytes[64];
+  ssize_t n = 0;
+  for (;;){
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 20) == 0){
+      if (reader.idle() != PC1550TelemetryReader::MORE)
+        printf("%3u  packet cut short\n", reader.sequence);
+      continue;
+    }
+    if ((n = read(fd, bytes, sizeof(bytes))) <= 0)
+      break;
+    for (ssize_t i = 0; i < n; i++){
+      uint8_t result = reader.push(bytes[i]);
+      if (result == PC1550TelemetryReader::UPDATE)
+        printf("%3u%s controller %04X  pc16out %04X  keypad %02X\n",
+               reader.sequence, reader.keyframe ? "*" : " ",
+               reader.controller, reader.pc16out, reader.keypad);
+      else if (result == PC1550TelemetryReader::LOST)
+        printf("%3u  lost packets, waiting for a keyframe\n", reader.sequence);
+      fflush(stdout);
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+int main(int argc, char **argv){
+  if (argc > 2 && strcmp(argv[1], "-d") == 0)
+    return decodePort(argv[2], argc > 3 ? strtoul(argv[3], 0, 10) : 115200);
+
+  double seconds = argc > 1 ? atof(argv[1]) : 60;
+  unsigned long corruptOneIn = argc > 2 ? strtoul(argv[2], 0, 10) : 0;
+
+  //the sketch writes to the master side, the host reads the other
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0){
+    perror("posix_openpt");
+    return 2;
+  }
+  int port = open(ptsname(master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (port < 0){
+    perror(ptsname(master));
+    return 2;
+  }
+  struct termios tio;
+  tcgetattr(port, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(port, TCSANOW, &tio);
+
+  PC1550Sim sim;
+  PC1550SetBackend(&sim);
+  PC1550 panel;
+  PC1550TelemetryWriter writer;
+  PC1550TelemetryReader reader;
+
+  uint16_t controller = 0b0000000010000000;
+  sim.setControllerData(controller);
+  sim.setPC16OutData(0);
+
+  unsigned long frames = 0, packets = 0, bytesSent = 0, textBytes = 0;
+  unsigned long bytesRead = 0;
+  unsigned long mismatches = 0, staleFrames = 0, corrupted = 0;
+  uint32_t seed = 7;
+  unsigned long end = (unsigned long)(seconds * 1e6);
+  while (sim.micros() < end){
+    sim.advance(200);
+    panel.processClockCycle();
+    if (!panel.atTransmissionEnd())
+      continue;
+    frames++;
+
+    //a zone opens or closes every couple of seconds, and a key is
+    //pressed now and then
+    if (frames % 29 == 0){
+      controller ^= 0x8000 >> (frames / 29 % 6);
+      sim.setControllerData(controller);
+      sim.setPC16OutData(controller & 0xFC00);
+    }
+    if (frames % 97 == 0)
+      sim.pressKey('1' + frames / 97 % 9, 2);
+
+    PC1550::Snapshot snap = panel.snapshot();
+    char text[32];
+    textBytes += snprintf(text, sizeof(text), "%04X %04X %02X\n",
+                          snap.controller, snap.pc16out, snap.keypad);
+
+    uint8_t packet[PC1550_TELEMETRY_MAX_PACKET];
+    uint8_t length = writer.encode(snap.controller, snap.pc16out,
+                                   snap.keypad, packet);
+    if (length > 0){
+      packets++;
+      bytesSent += length;
+      for (uint8_t i = 0; i < length && corruptOneIn > 0; i++){
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 8) % corruptOneIn == 0){
+          packet[i] ^= 1 << ((seed >> 4) & 7);
+          corrupted++;
+        }
+      }
+      if (write(master, packet, length) != length){
+        perror("write");
+        return 2;
+      }
+    }
+
+    //the pty hands bytes over asynchronously, so wait for all of them
+    while (bytesRead < bytesSent){
+      struct pollfd pfd = { port, POLLIN, 0 };
+      if (poll(&pfd, 1, 1000) <= 0){
+        fprintf(stderr, "pty stalled\n");
+        return 2;
+      }
+      uint8_t bytes[64];
+      ssize_t n = read(port, bytes, sizeof(bytes));
+      for (ssize_t i = 0; i < n; i++)
+        reader.push(bytes[i]);
+      if (n > 0)
+        bytesRead += n;
+    }
+    reader.idle();
+
+    if (!reader.valid)
+      staleFrames++;
+    else if (reader.controller != snap.controller ||
+             reader.pc16out != snap.pc16out || reader.keypad != snap.keypad)
+      mismatches++;
+  }
+
+  printf("frames             %lu\n", frames);
+  printf("packets            %lu (%.2f per frame)\n", packets,
+         frames ? (double)packets / frames : 0.0);
+  printf("bytes sent         %lu (%.2f per frame, text would be %lu)\n",
+         bytesSent, frames ? (double)bytesSent / frames : 0.0, textBytes);
+  printf("bytes corrupted    %lu\n", corrupted);
+  printf("reader             %lu packets, %lu lost, %lu bad crc\n",
+         (unsigned long)reader.packets, (unsigned long)reader.packetsLost,
+         (unsigned long)reader.crcErrors);
+  printf("frames stale       %lu\n", staleFrames);
+  printf("frames mismatched  %lu\n", mismatches);
+
+  close(port);
+  close(master);
+  bool ok = mismatches == 0 && reader.packets > 0 &&
+    (corruptOneIn > 0 || (reader.packetsLost == 0 && staleFrames == 0));
+  return ok ? 0 : 1;
+}